@@ -36,7 +36,9 @@
  * #L%
  */
 
+#include "fill.h"
 #include "result.h"
+#include "write-behind.h"
 
 #include <algorithm>
 #include <cstdlib>
@@ -49,12 +51,9 @@
 #include <sstream>
 #include <vector>
 
+#include <boost/chrono/system_clocks.hpp>
 #include <boost/filesystem.hpp>
 
-#include <boost/random/normal_distribution.hpp>
-#include <boost/random/uniform_01.hpp>
-#include <boost/random.hpp>
-
 #include <ome/compat/array.h>
 #include <ome/common/log.h>
 
@@ -64,87 +63,18 @@
 #include <ome/files/VariantPixelBuffer.h>
 
 using namespace ome::files::tiff;
-using ome::files::PixelBuffer;
-using ome::files::PixelProperties;
 using ome::files::VariantPixelBuffer;
 using ome::xml::model::enums::PixelType;
 
 namespace
 {
 
-  struct RandomFillVisitor : public boost::static_visitor<>
-  {
-    RandomFillVisitor():
-      rng(9343)
-    {
-    }
-
-    template<typename T>
-    typename boost::enable_if_c<
-      boost::is_integral<T>::value, void
-      >::type
-    operator() (std::shared_ptr<PixelBuffer<T>>& buffer)
-    {
-      boost::random::uniform_int_distribution<T> distrib
-        (std::numeric_limits<T>::min(), std::numeric_limits<T>::max() - 1);
-      typename PixelBuffer<T>::value_type *data = buffer->data();
-      for(typename PixelBuffer<T>::size_type i = 0;
-          i < buffer->num_elements();
-          ++i)
-        {
-          data[i] = distrib(rng);
-        }
-    }
-
-    template<typename T>
-    typename boost::enable_if_c<
-      boost::is_floating_point<T>::value, void
-      >::type
-    operator() (std::shared_ptr<PixelBuffer<T>>& buffer)
-    {
-      boost::random::uniform_real_distribution<T> distrib(0, 1);
-
-      typename PixelBuffer<T>::value_type *data = buffer->data();
-      for(typename PixelBuffer<T>::size_type i = 0;
-          i < buffer->num_elements();
-          ++i)
-        {
-          data[i] = distrib(rng);
-        }
-    }
-
-    template<typename T>
-    void
-    operator() (std::shared_ptr<PixelBuffer<std::complex<T>>>& buffer)
-    {
-      boost::random::uniform_real_distribution<T> distrib(0, 1);
-
-      typename PixelBuffer<std::complex<T>>::value_type *data = buffer->data();
-      for(typename PixelBuffer<std::complex<T>>::size_type i = 0;
-          i < buffer->num_elements();
-          ++i)
-        {
-          data[i] = std::complex<T>(distrib(rng),distrib(rng));
-        }
-    }
-
-    void
-    operator() (std::shared_ptr<PixelBuffer<PixelProperties<PixelType::BIT>::std_type>>& buffer)
+  enum write_mode
     {
-      boost::random::uniform_01<boost::mt19937> distrib(rng);
-
-      typename PixelBuffer<PixelProperties<::ome::xml::model::enums::PixelType::BIT>::std_type>::value_type *data = buffer->data();
-      for(typename PixelBuffer<PixelProperties<::ome::xml::model::enums::PixelType::BIT>::std_type>::size_type i = 0;
-          i < buffer->num_elements();
-          ++i)
-        {
-          data[i] = distrib();
-        }
-    }
-
-  private:
-    boost::mt19937 rng;
-  };
+      SYNC,    ///< Write the same tile repeatedly, synchronously.
+      COMPUTE, ///< Fill each tile before writing it synchronously.
+      BEHIND   ///< Fill each tile while the previous tile is written in the background.
+    };
 
   struct test_data
   {
@@ -163,11 +93,19 @@ namespace
 
   void
   run_tests(const std::vector<test_data>& tests,
+            write_mode mode,
             std::ofstream& results,
-            std::ofstream& sizes)
+            std::ofstream& sizes,
+            std::ofstream& stalls)
   {
     RandomFillVisitor random_fill;
 
+    std::string testname("pixeldata.write");
+    if (mode == COMPUTE)
+      testname += ".compute";
+    else if (mode == BEHIND)
+      testname += ".behind";
+
     for (const auto& t : tests)
       {
 
@@ -194,24 +132,89 @@ namespace
         ifd->setPlanarConfiguration(CONTIG);
         ifd->setPhotometricInterpretation(MIN_IS_BLACK);
 
+        // Time the producer spent blocked waiting for writes.
+        boost::chrono::steady_clock::duration stall(0);
+
         timepoint write_start;
 
-        for (unsigned int tilex = 0; tilex < t.tilexcount; ++tilex)
+        if (mode == SYNC)
           {
-            unsigned int x = tilex * t.tilexsize;
-            unsigned int sx = t.tilexsize;
-            for (unsigned int tiley = 0; tiley < t.tileycount; ++tiley)
+            for (unsigned int tilex = 0; tilex < t.tilexcount; ++tilex)
               {
-                unsigned int y = tiley * t.tileysize;
-                unsigned int sy = t.tileysize;
-                ifd->writeImage(buf, x, y, sx, sy);
+                unsigned int x = tilex * t.tilexsize;
+                unsigned int sx = t.tilexsize;
+                for (unsigned int tiley = 0; tiley < t.tileycount; ++tiley)
+                  {
+                    unsigned int y = tiley * t.tileysize;
+                    unsigned int sy = t.tileysize;
+                    // Only time the writes if the stall is recorded,
+                    // so that the default write loop is unchanged.
+                    if (stalls.is_open())
+                      {
+                        auto stall_start = boost::chrono::steady_clock::now();
+                        ifd->writeImage(buf, x, y, sx, sy);
+                        stall += boost::chrono::steady_clock::now() - stall_start;
+                      }
+                    else
+                      ifd->writeImage(buf, x, y, sx, sy);
+                  }
+              }
+          }
+        else
+          {
+            // Double buffering: one tile is filled while the other is
+            // being written.
+            VariantPixelBuffer spare(boost::extents[t.tilexsize][t.tileysize][1][1][1][1][1][1][1],
+                                     t.pixeltype);
+            VariantPixelBuffer *tiles[2] = {&buf, &spare};
+            unsigned int current = 0;
+
+            std::unique_ptr<write_behind> writer;
+            if (mode == BEHIND)
+              writer = std::make_unique<write_behind>(1);
+
+            for (unsigned int tilex = 0; tilex < t.tilexcount; ++tilex)
+              {
+                unsigned int x = tilex * t.tilexsize;
+                unsigned int sx = t.tilexsize;
+                for (unsigned int tiley = 0; tiley < t.tileycount; ++tiley)
+                  {
+                    unsigned int y = tiley * t.tileysize;
+                    unsigned int sy = t.tileysize;
+                    VariantPixelBuffer& tile = *tiles[current];
+
+                    boost::apply_visitor(random_fill, tile.vbuffer());
+
+                    auto stall_start = boost::chrono::steady_clock::now();
+                    if (writer)
+                      writer->submit([&ifd, &tile, x, y, sx, sy]()
+                                     {
+                                       ifd->writeImage(tile, x, y, sx, sy);
+                                     });
+                    else
+                      ifd->writeImage(tile, x, y, sx, sy);
+                    stall += boost::chrono::steady_clock::now() - stall_start;
+
+                    current = 1 - current;
+                  }
+              }
+
+            if (writer)
+              {
+                auto stall_start = boost::chrono::steady_clock::now();
+                writer->wait();
+                stall += boost::chrono::steady_clock::now() - stall_start;
               }
           }
         tiff->close();
 
         timepoint write_end;
-        result(results, "pixeldata.write", t.description, write_start, write_end);
-        extra_result(sizes, "pixeldata.write", t.description, boost::filesystem::file_size(t.output_file));
+        result(results, testname, t.description, write_start, write_end);
+        extra_result(sizes, testname, t.description, boost::filesystem::file_size(t.output_file));
+        if (stalls.is_open())
+          extra_result(stalls, testname, t.description,
+                       t.tilexcount * t.tileycount,
+                       boost::chrono::duration_cast<boost::chrono::milliseconds>(stall).count());
       }
 
     // Intermediate cleanup
@@ -223,9 +226,9 @@ namespace
 
 int main(int argc, char *argv[])
 {
-  if (argc != 12)
+  if (argc != 12 && argc != 14)
     {
-      std::cerr << "Usage: " << argv[0] << " iterations sizex sizey tiletype tilesizestart tilesizeend tilesizestep pixeltype outputfileprefix resultfile sizefile\n";
+      std::cerr << "Usage: " << argv[0] << " iterations sizex sizey tiletype tilesizestart tilesizeend tilesizestep pixeltype outputfileprefix resultfile sizefile [sync|compute|behind stallfile]\n";
       std::exit(1);
     }
 
@@ -245,6 +248,25 @@ int main(int argc, char *argv[])
       boost::filesystem::path resultfile(argv[10]);
       boost::filesystem::path sizefile(argv[11]);
 
+      write_mode mode = SYNC;
+      boost::filesystem::path stallfile;
+      if (argc == 14)
+        {
+          std::string modename(argv[12]);
+          if (modename == "sync")
+            mode = SYNC;
+          else if (modename == "compute")
+            mode = COMPUTE;
+          else if (modename == "behind")
+            mode = BEHIND;
+          else
+            {
+              std::cerr << "Invalid write mode: " << modename << '\n';
+              std::exit(1);
+            }
+          stallfile = argv[13];
+        }
+
       std::vector<test_data> tests;
       for(unsigned int tilesize = tilestart;
           tilesize <= tileend;
@@ -283,9 +305,14 @@ int main(int argc, char *argv[])
 
     std::ofstream results(resultfile.string().c_str());
     std::ofstream sizes(sizefile.string().c_str());
+    std::ofstream stalls;
+    if (!stallfile.empty())
+      stalls.open(stallfile.string().c_str());
 
     result_header(results);
     extra_result_header(sizes, {{"filesize"}});
+    if (stalls.is_open())
+      extra_result_header(stalls, {{"tiles"}, {"stall"}});
 
     for(int i = 0; i < iterations; ++i)
         {
@@ -296,7 +323,7 @@ int main(int argc, char *argv[])
           for (auto& t : tests)
             t.iteration = i;
 
-          run_tests(tests, results, sizes);
+          run_tests(tests, mode, results, sizes, stalls);
         }
 
       return 0;
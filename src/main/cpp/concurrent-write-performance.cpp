@@ -0,0 +1,395 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "fill.h"
+#include "result.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
+
+#include <ome/compat/array.h>
+#include <ome/common/log.h>
+
+#include <ome/files/tiff/TIFF.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/PixelProperties.h>
+#include <ome/files/VariantPixelBuffer.h>
+
+using namespace ome::files::tiff;
+using ome::files::VariantPixelBuffer;
+using ome::xml::model::enums::PixelType;
+
+namespace
+{
+
+  enum writer_mode
+    {
+      THREAD, ///< One writer thread per output file.
+      PROCESS ///< One writer process per output file.
+    };
+
+  struct test_data
+  {
+    PixelType pixeltype;
+    unsigned int sizex;
+    unsigned int sizey;
+    unsigned int tilesize;
+    std::string description;
+  };
+
+  /**
+   * Write a single tiled TIFF file of random pixel data.
+   *
+   * This is the same write loop as basic-tile-performance.  Each
+   * writer uses its own pixel buffer and TIFF, so the only shared
+   * state is that internal to the libraries.
+   *
+   * @param t the test parameters.
+   * @param output_file the file to write.
+   * @returns the elapsed real time in milliseconds.
+   */
+  double
+  write_file(const test_data& t,
+             const boost::filesystem::path& output_file)
+  {
+    RandomFillVisitor random_fill;
+
+    VariantPixelBuffer buf(boost::extents[t.tilesize][t.tilesize][1][1][1][1][1][1][1],
+                           t.pixeltype);
+    boost::apply_visitor(random_fill, buf.vbuffer());
+
+    timepoint write_start;
+
+    auto tiff = TIFF::open(output_file, "w8");
+    auto ifd = tiff->getCurrentDirectory();
+    ifd->setImageWidth(t.sizex);
+    ifd->setImageHeight(t.sizey);
+    ifd->setTileType(TILE);
+    ifd->setTileWidth(t.tilesize);
+    ifd->setTileHeight(t.tilesize);
+
+    ifd->setPixelType(t.pixeltype);
+    ifd->setBitsPerSample(ome::files::bitsPerPixel(t.pixeltype));
+    ifd->setSamplesPerPixel(1);
+    ifd->setPlanarConfiguration(CONTIG);
+    ifd->setPhotometricInterpretation(MIN_IS_BLACK);
+
+    for (unsigned int x = 0; x < t.sizex; x += t.tilesize)
+      for (unsigned int y = 0; y < t.sizey; y += t.tilesize)
+        ifd->writeImage(buf, x, y, t.tilesize, t.tilesize);
+    tiff->close();
+
+    timepoint write_end;
+
+    return elapsed_real(write_start, write_end);
+  }
+
+  /**
+   * Write one file per thread, concurrently.
+   *
+   * @param t the test parameters.
+   * @param files the files to write.
+   * @param policy the thread placement policy.
+   * @param elapsed the elapsed real time for each file in milliseconds.
+   * @returns the CPUs used.
+   */
+  std::string
+  write_threads(const test_data& t,
+                const std::vector<boost::filesystem::path>& files,
+                placement_policy policy,
+                std::vector<double>& elapsed)
+  {
+    elapsed.assign(files.size(), 0.0);
+    return run_threads(files.size(), policy,
+                       [&](unsigned int k)
+                       {
+                         elapsed.at(k) = write_file(t, files.at(k));
+                       });
+  }
+
+  /**
+   * Write one file per child process, concurrently.
+   *
+   * Each child reports its elapsed time to the parent via a pipe.
+   * Children are pinned to CPUs as for threads.  Memory interleaving
+   * is not supported.
+   *
+   * @param t the test parameters.
+   * @param files the files to write.
+   * @param policy the placement policy.
+   * @param elapsed the elapsed real time for each file in milliseconds.
+   * @returns the CPUs used.
+   */
+  std::string
+  write_processes(const test_data& t,
+                  const std::vector<boost::filesystem::path>& files,
+                  placement_policy policy,
+                  std::vector<double>& elapsed)
+  {
+#ifdef _WIN32
+    throw std::runtime_error("Process writers are not supported on this platform");
+#else
+    std::vector<unsigned int> cpus = placement_cpus(policy, files.size());
+    elapsed.assign(files.size(), 0.0);
+    std::vector<pid_t> children;
+    std::vector<int> pipes;
+
+    std::cout << std::flush;
+
+    for (std::size_t k = 0; k < files.size(); ++k)
+      {
+        int fds[2];
+        if (pipe(fds) != 0)
+          throw std::runtime_error("Failed to create pipe");
+
+        pid_t pid = fork();
+        if (pid < 0)
+          throw std::runtime_error("Failed to fork writer process");
+        if (pid == 0)
+          {
+            close(fds[0]);
+            double child_elapsed = -1.0;
+            try
+              {
+#ifdef __linux__
+                if (!cpus.empty())
+                  {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpus.at(k), &set);
+                    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+                      throw std::runtime_error("Failed to pin process to CPU " +
+                                               std::to_string(cpus.at(k)) + ": " +
+                                               std::strerror(errno));
+                  }
+#endif
+                child_elapsed = write_file(t, files.at(k));
+              }
+            catch (const std::exception& e)
+              {
+                std::cerr << "Error: writer " << k << ": " << e.what() << '\n';
+              }
+            ssize_t written = write(fds[1], &child_elapsed, sizeof(child_elapsed));
+            close(fds[1]);
+            // Skip exit handlers and destructors inherited from the parent.
+            _exit(written == sizeof(child_elapsed) && child_elapsed >= 0.0 ? 0 : 1);
+          }
+
+        close(fds[1]);
+        children.push_back(pid);
+        pipes.push_back(fds[0]);
+      }
+
+    bool failed = false;
+    for (std::size_t k = 0; k < children.size(); ++k)
+      {
+        if (read(pipes.at(k), &elapsed.at(k), sizeof(double)) != sizeof(double))
+          failed = true;
+        close(pipes.at(k));
+
+        int status;
+        if (waitpid(children.at(k), &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+          failed = true;
+      }
+
+    if (failed)
+      throw std::runtime_error("Writer process failed");
+
+    if (cpus.empty())
+      return "-";
+
+    std::ostringstream list;
+    for (std::size_t k = 0; k < cpus.size(); ++k)
+      list << (k ? "," : "") << cpus.at(k);
+    return list.str();
+#endif
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 11 && argc != 12)
+    {
+      std::cerr << "Usage: " << argv[0] << " iterations thread|process maxwriters sizex sizey tilesize pixeltype outputfileprefix resultfile scalingfile [none|compact|scatter|node|interleave]\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      int iterations = std::strtol(argv[1], nullptr, 10);
+      std::string modename(argv[2]);
+      unsigned int maxwriters = std::strtoul(argv[3], nullptr, 10);
+      unsigned int sizex = std::strtoul(argv[4], nullptr, 10);
+      unsigned int sizey = std::strtoul(argv[5], nullptr, 10);
+      unsigned int tilesize = std::strtoul(argv[6], nullptr, 10);
+      std::string pixeltype(argv[7]);
+      std::string outfileprefix(argv[8]);
+      boost::filesystem::path resultfile(argv[9]);
+      boost::filesystem::path scalingfile(argv[10]);
+      placement_policy policy = parse_placement(argc == 12 ? argv[11] : "none");
+
+      writer_mode mode;
+      if (modename == "thread")
+        mode = THREAD;
+      else if (modename == "process")
+        mode = PROCESS;
+      else
+        {
+          std::cerr << "Invalid writer mode: " << modename << '\n';
+          std::exit(1);
+        }
+
+      if (mode == PROCESS && policy == PLACE_INTERLEAVE)
+        {
+          std::cerr << "Memory interleaving is not supported for writer processes\n";
+          std::exit(1);
+        }
+
+      test_data t {{pixeltype}, sizex, sizey, tilesize, {}};
+
+      std::ostringstream desc;
+      desc << t.sizex << '-' << t.sizey << '-'
+           << "tile" << '-'
+           << t.tilesize << '-' << t.tilesize << '-'
+           << t.pixeltype;
+      t.description = desc.str();
+
+      double filebytes = static_cast<double>(t.sizex) * t.sizey * ome::files::bytesPerPixel(t.pixeltype);
+
+      std::string testname = "pixeldata.write.concurrent." + modename;
+
+      std::ofstream results(resultfile.string().c_str());
+      std::ofstream scaling(scalingfile.string().c_str());
+
+      result_header(results);
+      extra_result_header(scaling,
+                          {{"writers.mode"}, {"placement"}, {"writers"}, {"cpus"}, {"iteration"},
+                           {"bytes.total"}, {"real"}, {"rate.mibs"},
+                           {"file.mean"}, {"file.max"}, {"slowdown"}});
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          // Mean single-writer time for this iteration.
+          double baseline = 0.0;
+
+          for (unsigned int writers = 1; writers <= maxwriters; ++writers)
+            {
+              std::cout << "TEST: [" << i << "] " << t.description
+                        << " with " << writers << ' ' << modename << " writers" << std::endl;
+
+              std::vector<boost::filesystem::path> files;
+              for (unsigned int k = 0; k < writers; ++k)
+                {
+                  std::ostringstream name;
+                  name << outfileprefix << '-' << t.description << '-' << k << ".tiff";
+                  files.push_back(name.str());
+                  boost::filesystem::remove(files.back());
+                }
+
+              timepoint write_start;
+
+              std::vector<double> elapsed;
+              std::string cpus = (mode == THREAD) ?
+                write_threads(t, files, policy, elapsed) :
+                write_processes(t, files, policy, elapsed);
+
+              timepoint write_end;
+
+              double real = elapsed_real(write_start, write_end);
+              double mean = 0.0;
+              for (auto e : elapsed)
+                mean += e;
+              mean /= elapsed.size();
+              double max = *std::max_element(elapsed.begin(), elapsed.end());
+              if (writers == 1)
+                baseline = mean;
+
+              double totalbytes = filebytes * writers;
+              double rate = real > 0.0 ? (totalbytes / (1024.0 * 1024.0)) / (real / 1000.0) : 0.0;
+
+              std::ostringstream testfile;
+              testfile << t.description << '-' << writers;
+
+              result(results, testname, testfile.str(), write_start, write_end);
+              extra_result(scaling, testname, t.description,
+                           modename, placement_name(policy), writers, cpus, i,
+                           static_cast<std::uint64_t>(totalbytes), real, rate,
+                           mean, max, baseline > 0.0 ? mean / baseline : 0.0);
+
+              for (const auto& file : files)
+                boost::filesystem::remove(file);
+            }
+        }
+
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
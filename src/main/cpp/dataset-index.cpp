@@ -0,0 +1,420 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "dataset-index.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/files/FormatException.h>
+#include <ome/files/FormatTools.h>
+#include <ome/files/MetadataTools.h>
+#include <ome/files/tiff/Exception.h>
+#include <ome/files/tiff/Field.h>
+
+using ome::files::dimension_size_type;
+
+namespace
+{
+
+  /// Cache file identifier.
+  const char cache_magic[4] = {'O', 'F', 'P', 'I'};
+
+  /// Cache file format version.
+  const std::uint32_t cache_version = 1;
+
+  /**
+   * Get an optional metadata value.
+   *
+   * @param getter the metadata getter to call.
+   * @param fallback the value to use if the value is not set.
+   * @param set set to @c true if the value was set, or @c false if not.
+   * @returns the value, or the fallback value.
+   */
+  template<typename Getter>
+  dimension_size_type
+  optional_value(Getter getter,
+                 dimension_size_type fallback,
+                 bool& set)
+  {
+    try
+      {
+        dimension_size_type value = static_cast<dimension_size_type>(getter());
+        set = true;
+        return value;
+      }
+    catch (const std::exception&)
+      {
+        set = false;
+        return fallback;
+      }
+  }
+
+  template<typename Getter>
+  dimension_size_type
+  optional_value(Getter getter,
+                 dimension_size_type fallback)
+  {
+    bool set;
+    return optional_value(getter, fallback, set);
+  }
+
+  template<typename T>
+  void
+  write_value(std::ostream& os, T value)
+  {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void
+  write_string(std::ostream& os, const std::string& value)
+  {
+    write_value<std::uint64_t>(os, value.size());
+    os.write(value.data(), value.size());
+  }
+
+  template<typename T>
+  T
+  read_value(std::istream& is)
+  {
+    T value = T();
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return value;
+  }
+
+  std::string
+  read_string(std::istream& is)
+  {
+    std::uint64_t size = read_value<std::uint64_t>(is);
+    std::string value;
+    if (is)
+      {
+        value.resize(size);
+        is.read(&value[0], size);
+      }
+    return value;
+  }
+
+}
+
+std::string
+read_omexml(const boost::filesystem::path& file)
+{
+  std::string omexml;
+  try
+    {
+      std::shared_ptr<ome::files::tiff::TIFF> tiff = ome::files::tiff::TIFF::open(file, "r");
+      std::shared_ptr<ome::files::tiff::IFD> ifd (tiff->getDirectoryByIndex(0));
+      if (ifd)
+        ifd->getField(ome::files::tiff::IMAGEDESCRIPTION).get(omexml);
+      else
+        throw ome::files::tiff::Exception("No TIFF IFDs found");
+    }
+  catch (const ome::files::tiff::Exception&)
+    {
+      throw ome::files::FormatException("No TIFF ImageDescription found");
+    }
+  return omexml;
+}
+
+dataset_index
+build_index(const ome::xml::meta::MetadataRetrieve& meta,
+            const boost::filesystem::path& infile)
+{
+  dataset_index index;
+
+  boost::filesystem::path primary(boost::filesystem::absolute(infile));
+  boost::filesystem::path dir(primary.parent_path());
+
+  std::map<boost::filesystem::path, std::uint32_t> file_ids;
+  file_ids.insert(std::make_pair(primary, 0U));
+  index.files.push_back(file_index{primary, 0, 0, {}});
+
+  for (dimension_size_type image = 0; image < meta.getImageCount(); ++image)
+    {
+      series_index series;
+      series.sizex = static_cast<dimension_size_type>(meta.getPixelsSizeX(image));
+      series.sizey = static_cast<dimension_size_type>(meta.getPixelsSizeY(image));
+      series.sizez = static_cast<dimension_size_type>(meta.getPixelsSizeZ(image));
+      series.sizec = static_cast<dimension_size_type>(meta.getPixelsSizeC(image));
+      series.sizet = static_cast<dimension_size_type>(meta.getPixelsSizeT(image));
+      series.samples = 1;
+      if (meta.getChannelCount(image) > 0)
+        series.samples = optional_value([&]{ return meta.getChannelSamplesPerPixel(image, 0); }, 1);
+      if (!series.samples)
+        series.samples = 1;
+
+      std::ostringstream pixeltype;
+      pixeltype << meta.getPixelsType(image);
+      series.pixeltype = pixeltype.str();
+
+      std::ostringstream order;
+      order << meta.getPixelsDimensionOrder(image);
+      series.dimension_order = order.str();
+
+      // Samples within a channel are stored within the same plane.
+      dimension_size_type effc = std::max(series.sizec / series.samples, dimension_size_type(1));
+      dimension_size_type nplanes = series.sizez * effc * series.sizet;
+
+      // Without TiffData, planes are in IFD order in the primary file.
+      series.planes.resize(nplanes);
+      for (dimension_size_type plane = 0; plane < nplanes; ++plane)
+        series.planes[plane] = plane_location{0, static_cast<std::uint32_t>(plane)};
+
+      for (dimension_size_type td = 0; td < meta.getTiffDataCount(image); ++td)
+        {
+          bool has_ifd;
+          dimension_size_type ifd = optional_value([&]{ return meta.getTiffDataIFD(image, td); }, 0, has_ifd);
+          dimension_size_type firstz = optional_value([&]{ return meta.getTiffDataFirstZ(image, td); }, 0);
+          dimension_size_type firstc = optional_value([&]{ return meta.getTiffDataFirstC(image, td); }, 0);
+          dimension_size_type firstt = optional_value([&]{ return meta.getTiffDataFirstT(image, td); }, 0);
+
+          dimension_size_type start = ome::files::getIndex(series.dimension_order,
+                                                           series.sizez, effc, series.sizet,
+                                                           nplanes,
+                                                           firstz, firstc, firstt);
+
+          // PlaneCount defaults to one if an IFD is specified, or to
+          // all of the remaining planes if not.
+          dimension_size_type count = optional_value([&]{ return meta.getTiffDataPlaneCount(image, td); },
+                                                     has_ifd ? 1 : nplanes - start);
+
+          boost::filesystem::path file(primary);
+          try
+            {
+              file = dir / meta.getUUIDFileName(image, td);
+            }
+          catch (const std::exception&)
+            {
+              // No UUID; the planes are in the primary file.
+            }
+
+          auto id = file_ids.find(file);
+          if (id == file_ids.end())
+            {
+              id = file_ids.insert(std::make_pair(file, static_cast<std::uint32_t>(index.files.size()))).first;
+              index.files.push_back(file_index{file, 0, 0, {}});
+            }
+
+          for (dimension_size_type plane = 0; plane < count && start + plane < nplanes; ++plane)
+            series.planes[start + plane] = plane_location{id->second, static_cast<std::uint32_t>(ifd + plane)};
+        }
+
+      index.series.push_back(series);
+    }
+
+  return index;
+}
+
+void
+index_file(file_index& file)
+{
+  std::shared_ptr<ome::files::tiff::TIFF> tiff = ome::files::tiff::TIFF::open(file.path, "r");
+  index_file(file, *tiff);
+}
+
+void
+index_file(file_index& file,
+           const ome::files::tiff::TIFF& tiff)
+{
+  file.size = boost::filesystem::file_size(file.path);
+  file.mtime = boost::filesystem::last_write_time(file.path);
+  file.ifd_offsets.clear();
+
+  for (auto i = tiff.begin(); i != tiff.end(); ++i)
+    {
+      std::shared_ptr<ome::files::tiff::IFD> ifd(*i);
+      file.ifd_offsets.push_back(ifd->getOffset());
+    }
+}
+
+void
+write_index(const dataset_index& index,
+            const boost::filesystem::path& cachefile)
+{
+  std::ofstream os(cachefile.string().c_str(), std::ios::binary | std::ios::trunc);
+
+  os.write(cache_magic, sizeof(cache_magic));
+  write_value<std::uint32_t>(os, cache_version);
+
+  write_value<std::uint64_t>(os, index.files.size());
+  for (const auto& file : index.files)
+    {
+      write_string(os, file.path.string());
+      write_value<std::uint64_t>(os, file.size);
+      write_value<std::int64_t>(os, file.mtime);
+      write_value<std::uint64_t>(os, file.ifd_offsets.size());
+      os.write(reinterpret_cast<const char *>(file.ifd_offsets.data()),
+               file.ifd_offsets.size() * sizeof(std::uint64_t));
+    }
+
+  write_value<std::uint64_t>(os, index.series.size());
+  for (const auto& series : index.series)
+    {
+      write_value<std::uint64_t>(os, series.sizex);
+      write_value<std::uint64_t>(os, series.sizey);
+      write_value<std::uint64_t>(os, series.sizez);
+      write_value<std::uint64_t>(os, series.sizec);
+      write_value<std::uint64_t>(os, series.sizet);
+      write_value<std::uint64_t>(os, series.samples);
+      write_string(os, series.pixeltype);
+      write_string(os, series.dimension_order);
+      write_value<std::uint64_t>(os, series.planes.size());
+      os.write(reinterpret_cast<const char *>(series.planes.data()),
+               series.planes.size() * sizeof(plane_location));
+    }
+
+  write_string(os, index.omexml);
+
+  os.close();
+  if (!os)
+    throw std::runtime_error("Failed to write index cache " + cachefile.string());
+}
+
+bool
+read_index(dataset_index& index,
+           const boost::filesystem::path& cachefile)
+{
+  std::ifstream is(cachefile.string().c_str(), std::ios::binary);
+  if (!is)
+    return false;
+
+  char magic[sizeof(cache_magic)];
+  is.read(magic, sizeof(magic));
+  if (!is ||
+      !std::equal(magic, magic + sizeof(magic), cache_magic) ||
+      read_value<std::uint32_t>(is) != cache_version)
+    return false;
+
+  dataset_index cached;
+
+  try
+    {
+      cached.files.resize(read_value<std::uint64_t>(is));
+      for (auto& file : cached.files)
+        {
+          file.path = read_string(is);
+          file.size = read_value<std::uint64_t>(is);
+          file.mtime = static_cast<std::time_t>(read_value<std::int64_t>(is));
+          file.ifd_offsets.resize(read_value<std::uint64_t>(is));
+          is.read(reinterpret_cast<char *>(file.ifd_offsets.data()),
+                  file.ifd_offsets.size() * sizeof(std::uint64_t));
+          if (!is)
+            return false;
+        }
+
+      cached.series.resize(read_value<std::uint64_t>(is));
+      for (auto& series : cached.series)
+        {
+          series.sizex = read_value<std::uint64_t>(is);
+          series.sizey = read_value<std::uint64_t>(is);
+          series.sizez = read_value<std::uint64_t>(is);
+          series.sizec = read_value<std::uint64_t>(is);
+          series.sizet = read_value<std::uint64_t>(is);
+          series.samples = read_value<std::uint64_t>(is);
+          series.pixeltype = read_string(is);
+          series.dimension_order = read_string(is);
+          series.planes.resize(read_value<std::uint64_t>(is));
+          is.read(reinterpret_cast<char *>(series.planes.data()),
+                  series.planes.size() * sizeof(plane_location));
+          if (!is)
+            return false;
+        }
+
+      cached.omexml = read_string(is);
+      if (!is)
+        return false;
+    }
+  catch (const std::exception&)
+    {
+      // A truncated or corrupt cache may have unreasonable sizes.
+      return false;
+    }
+
+  // The cache is stale if any file has been changed.
+  for (const auto& file : cached.files)
+    {
+      boost::system::error_code ec;
+      if (boost::filesystem::file_size(file.path, ec) != file.size || ec ||
+          boost::filesystem::last_write_time(file.path, ec) != file.mtime || ec)
+        return false;
+    }
+
+  index = std::move(cached);
+  return true;
+}
+
+dataset_index
+load_index(const boost::filesystem::path& infile,
+           const boost::filesystem::path& cachefile,
+           bool& cached)
+{
+  dataset_index index;
+
+  // The primary file is always the first file in the index; a cache
+  // for a different dataset is treated as stale.
+  cached = read_index(index, cachefile) &&
+    !index.files.empty() &&
+    index.files.front().path == boost::filesystem::absolute(infile);
+  if (!cached)
+    {
+      std::string omexml = read_omexml(infile);
+      std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta = ome::files::createOMEXMLMetadata(omexml);
+      index = build_index(*meta, infile);
+      index.omexml = omexml;
+      for (auto& file : index.files)
+        index_file(file);
+      write_index(index, cachefile);
+    }
+
+  return index;
+}
+
+std::shared_ptr<ome::files::tiff::IFD>
+plane_ifd(const dataset_index& index,
+          const std::vector<std::shared_ptr<ome::files::tiff::TIFF>>& tiffs,
+          const plane_location& location)
+{
+  return tiffs.at(location.file)->getDirectoryByOffset(index.files.at(location.file).ifd_offsets.at(location.ifd));
+}
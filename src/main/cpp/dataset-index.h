@@ -0,0 +1,222 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include <ome/files/Types.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/tiff/TIFF.h>
+
+#include <ome/xml/meta/MetadataRetrieve.h>
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+/**
+ * Location of a single plane.
+ */
+struct plane_location
+{
+  /// Index of the file containing the plane.
+  std::uint32_t file;
+  /// Index of the IFD within the file.
+  std::uint32_t ifd;
+};
+
+/**
+ * A TIFF file making up part of a dataset.
+ */
+struct file_index
+{
+  /// File path.
+  boost::filesystem::path path;
+  /// File size when indexed.
+  std::uint64_t size;
+  /// File modification time when indexed.
+  std::time_t mtime;
+  /// Offsets of all IFDs in the file.
+  std::vector<std::uint64_t> ifd_offsets;
+};
+
+/**
+ * Core metadata and plane locations for a single series.
+ */
+struct series_index
+{
+  ome::files::dimension_size_type sizex;
+  ome::files::dimension_size_type sizey;
+  ome::files::dimension_size_type sizez;
+  ome::files::dimension_size_type sizec;
+  ome::files::dimension_size_type sizet;
+  ome::files::dimension_size_type samples;
+  std::string pixeltype;
+  std::string dimension_order;
+  /// Plane locations, in dimension order.
+  std::vector<plane_location> planes;
+};
+
+/**
+ * Index of all the files, IFDs and planes in a dataset.
+ *
+ * This contains everything needed to locate and read any plane in an
+ * OME-TIFF dataset without reparsing the OME-XML or walking the IFDs
+ * of every file.  The OME-XML text is retained so that the full
+ * metadata may be parsed on demand.
+ */
+struct dataset_index
+{
+  std::vector<file_index> files;
+  std::vector<series_index> series;
+  std::string omexml;
+};
+
+/**
+ * Get the OME-XML metadata embedded in an OME-TIFF file.
+ *
+ * @param file the OME-TIFF file.
+ * @returns the OME-XML text from the first ImageDescription.
+ */
+std::string
+read_omexml(const boost::filesystem::path& file);
+
+/**
+ * Create an index from OME-XML metadata.
+ *
+ * The files and planes are determined from the TiffData elements of
+ * each image.  The IFD offsets are not filled in; use index_file()
+ * for each file to complete the index.
+ *
+ * @param meta the metadata to index.
+ * @param infile the file the metadata was obtained from.  UUID
+ * filenames are relative to its directory.
+ * @returns the partially-filled index.
+ */
+dataset_index
+build_index(const ome::xml::meta::MetadataRetrieve& meta,
+            const boost::filesystem::path& infile);
+
+/**
+ * Record the size, modification time and IFD offsets of a file.
+ *
+ * @param file the file to index.
+ */
+void
+index_file(file_index& file);
+
+/**
+ * Record the size, modification time and IFD offsets of an open file.
+ *
+ * @param file the file to index.
+ * @param tiff the open TIFF for the file.
+ */
+void
+index_file(file_index& file,
+           const ome::files::tiff::TIFF& tiff);
+
+/**
+ * Write an index to a binary cache file.
+ *
+ * The cache uses the native byte order and is not intended to be
+ * portable between hosts.
+ *
+ * @param index the index to write.
+ * @param cachefile the file to write.
+ */
+void
+write_index(const dataset_index& index,
+            const boost::filesystem::path& cachefile);
+
+/**
+ * Read an index from a binary cache file.
+ *
+ * The index is only valid if the cache file is readable and all the
+ * indexed files have the same size and modification time as when
+ * they were indexed.
+ *
+ * @param index the index to fill.
+ * @param cachefile the file to read.
+ * @returns @c true if the index is valid, or @c false if it is
+ * missing or stale.
+ */
+bool
+read_index(dataset_index& index,
+           const boost::filesystem::path& cachefile);
+
+/**
+ * Load the index for an OME-TIFF dataset.
+ *
+ * If a valid cache file for @c infile exists, the index is read from
+ * it.
+ * Otherwise, the OME-XML metadata is parsed, the IFDs of every file
+ * are walked, and the resulting index is written to the cache file
+ * for use by later loads.
+ *
+ * @param infile the OME-TIFF file to index.
+ * @param cachefile the cache file to use.
+ * @param cached set to @c true if the index was read from the cache.
+ * @returns the index.
+ */
+dataset_index
+load_index(const boost::filesystem::path& infile,
+           const boost::filesystem::path& cachefile,
+           bool& cached);
+
+/**
+ * Get the IFD for a plane.
+ *
+ * @param index the dataset index.
+ * @param tiffs the open TIFF for each file in the index.
+ * @param location the plane location.
+ * @returns the IFD.
+ */
+std::shared_ptr<ome::files::tiff::IFD>
+plane_ifd(const dataset_index& index,
+          const std::vector<std::shared_ptr<ome::files::tiff::TIFF>>& tiffs,
+          const plane_location& location);
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
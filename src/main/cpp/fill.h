@@ -0,0 +1,134 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#pragma once
+
+#include <complex>
+#include <limits>
+#include <memory>
+
+#include <boost/random/uniform_01.hpp>
+#include <boost/random.hpp>
+
+#include <ome/files/PixelBuffer.h>
+#include <ome/files/PixelProperties.h>
+
+/**
+ * Fill a pixel buffer with random data.  The random number generator
+ * is seeded with a fixed value, so the same sequence of buffers will
+ * be generated by each visitor instance.
+ */
+struct RandomFillVisitor : public boost::static_visitor<>
+{
+  RandomFillVisitor():
+    rng(9343)
+  {
+  }
+
+  template<typename T>
+  typename boost::enable_if_c<
+    boost::is_integral<T>::value, void
+    >::type
+  operator() (std::shared_ptr<ome::files::PixelBuffer<T>>& buffer)
+  {
+    boost::random::uniform_int_distribution<T> distrib
+      (std::numeric_limits<T>::min(), std::numeric_limits<T>::max() - 1);
+    typename ome::files::PixelBuffer<T>::value_type *data = buffer->data();
+    for(typename ome::files::PixelBuffer<T>::size_type i = 0;
+        i < buffer->num_elements();
+        ++i)
+      {
+        data[i] = distrib(rng);
+      }
+  }
+
+  template<typename T>
+  typename boost::enable_if_c<
+    boost::is_floating_point<T>::value, void
+    >::type
+  operator() (std::shared_ptr<ome::files::PixelBuffer<T>>& buffer)
+  {
+    boost::random::uniform_real_distribution<T> distrib(0, 1);
+
+    typename ome::files::PixelBuffer<T>::value_type *data = buffer->data();
+    for(typename ome::files::PixelBuffer<T>::size_type i = 0;
+        i < buffer->num_elements();
+        ++i)
+      {
+        data[i] = distrib(rng);
+      }
+  }
+
+  template<typename T>
+  void
+  operator() (std::shared_ptr<ome::files::PixelBuffer<std::complex<T>>>& buffer)
+  {
+    boost::random::uniform_real_distribution<T> distrib(0, 1);
+
+    typename ome::files::PixelBuffer<std::complex<T>>::value_type *data = buffer->data();
+    for(typename ome::files::PixelBuffer<std::complex<T>>::size_type i = 0;
+        i < buffer->num_elements();
+        ++i)
+      {
+        data[i] = std::complex<T>(distrib(rng),distrib(rng));
+      }
+  }
+
+  void
+  operator() (std::shared_ptr<ome::files::PixelBuffer<ome::files::PixelProperties<ome::xml::model::enums::PixelType::BIT>::std_type>>& buffer)
+  {
+    boost::random::uniform_01<boost::mt19937> distrib(rng);
+
+    typename ome::files::PixelBuffer<ome::files::PixelProperties<::ome::xml::model::enums::PixelType::BIT>::std_type>::value_type *data = buffer->data();
+    for(typename ome::files::PixelBuffer<ome::files::PixelProperties<::ome::xml::model::enums::PixelType::BIT>::std_type>::size_type i = 0;
+        i < buffer->num_elements();
+        ++i)
+      {
+        data[i] = distrib();
+      }
+  }
+
+private:
+  boost::mt19937 rng;
+};
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
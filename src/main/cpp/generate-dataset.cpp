@@ -0,0 +1,442 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "dataset-index.h"
+#include "fill.h"
+#include "result.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/compat/array.h>
+#include <ome/common/log.h>
+
+#include <ome/files/CoreMetadata.h>
+#include <ome/files/MetadataTools.h>
+#include <ome/files/PixelProperties.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/in/OMETIFFReader.h>
+#include <ome/files/out/OMETIFFWriter.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+using ome::files::dimension_size_type;
+using ome::xml::model::enums::PixelType;
+
+namespace
+{
+
+  /**
+   * Synthetic dataset parameters.
+   */
+  struct dataset_params
+  {
+    dimension_size_type sizex;
+    dimension_size_type sizey;
+    dimension_size_type sizez;
+    dimension_size_type sizec;
+    dimension_size_type sizet;
+    dimension_size_type series;
+    PixelType pixeltype;
+    /// Tile width and height, or zero to write strips.
+    dimension_size_type tilesize;
+    /// Number of comment annotations attached to the first image.
+    dimension_size_type annotations;
+    /// Number of rectangle ROIs attached to the first image.
+    dimension_size_type rois;
+  };
+
+  std::string
+  describe(const dataset_params& p)
+  {
+    std::ostringstream desc;
+    desc << p.sizex << '-' << p.sizey << '-'
+         << p.sizez << '-' << p.sizec << '-' << p.sizet << '-'
+         << p.series << '-' << p.pixeltype << '-'
+         << p.tilesize << '-' << p.annotations << '-' << p.rois;
+    return desc.str();
+  }
+
+  /**
+   * Set a single parameter by name.
+   *
+   * The "plane" axis sets both the width and height.
+   *
+   * @param p the parameters to modify.
+   * @param axis the parameter name.
+   * @param value the new value.
+   */
+  void
+  set_axis(dataset_params& p,
+           const std::string& axis,
+           dimension_size_type value)
+  {
+    if (axis == "sizex")
+      p.sizex = value;
+    else if (axis == "sizey")
+      p.sizey = value;
+    else if (axis == "plane")
+      p.sizex = p.sizey = value;
+    else if (axis == "sizez")
+      p.sizez = value;
+    else if (axis == "sizec")
+      p.sizec = value;
+    else if (axis == "sizet")
+      p.sizet = value;
+    else if (axis == "series")
+      p.series = value;
+    else if (axis == "tilesize")
+      p.tilesize = value;
+    else if (axis == "annotations")
+      p.annotations = value;
+    else if (axis == "rois")
+      p.rois = value;
+    else
+      throw std::runtime_error("Invalid sweep axis: " + axis);
+  }
+
+  /**
+   * Create the OME-XML metadata for a synthetic dataset.
+   *
+   * @param p the dataset parameters.
+   * @returns the metadata.
+   */
+  std::shared_ptr<ome::xml::meta::OMEXMLMetadata>
+  create_metadata(const dataset_params& p)
+  {
+    if (!p.sizex || !p.sizey || !p.sizez || !p.sizec || !p.sizet || !p.series)
+      throw std::runtime_error("Dataset dimensions and series count must be non-zero");
+
+    std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta(std::make_shared<ome::xml::meta::OMEXMLMetadata>());
+
+    std::vector<std::shared_ptr<ome::files::CoreMetadata>> seriesList;
+    for (dimension_size_type s = 0; s < p.series; ++s)
+      {
+        std::shared_ptr<ome::files::CoreMetadata> core(std::make_shared<ome::files::CoreMetadata>());
+        core->sizeX = p.sizex;
+        core->sizeY = p.sizey;
+        core->sizeZ = p.sizez;
+        core->sizeC.clear();
+        core->sizeC.resize(p.sizec, 1);
+        core->sizeT = p.sizet;
+        core->pixelType = p.pixeltype;
+        core->bitsPerPixel = ome::files::bitsPerPixel(p.pixeltype);
+        core->interleaved = false;
+        core->dimensionOrder = ome::xml::model::enums::DimensionOrder::XYZCT;
+        core->imageCount = p.sizez * p.sizec * p.sizet;
+        seriesList.push_back(core);
+      }
+    ome::files::fillMetadata(*meta, seriesList);
+
+    for (dimension_size_type a = 0; a < p.annotations; ++a)
+      {
+        std::ostringstream id;
+        id << "Annotation:" << a;
+        std::ostringstream value;
+        value << "Synthetic annotation " << a;
+        meta->setCommentAnnotationID(id.str(), a);
+        meta->setCommentAnnotationValue(value.str(), a);
+        meta->setImageAnnotationRef(id.str(), 0, a);
+      }
+
+    for (dimension_size_type r = 0; r < p.rois; ++r)
+      {
+        std::ostringstream roi_id;
+        roi_id << "ROI:" << r;
+        std::ostringstream shape_id;
+        shape_id << "Shape:" << r << ":0";
+        meta->setROIID(roi_id.str(), r);
+        meta->setRectangleID(shape_id.str(), r, 0);
+        meta->setRectangleX(static_cast<double>((r * 7) % p.sizex), r, 0);
+        meta->setRectangleY(static_cast<double>((r * 13) % p.sizey), r, 0);
+        meta->setRectangleWidth(8.0, r, 0);
+        meta->setRectangleHeight(8.0, r, 0);
+        meta->setImageROIRef(roi_id.str(), 0, r);
+      }
+
+    return meta;
+  }
+
+  /**
+   * Create a plane of random pixel data for a synthetic dataset.
+   *
+   * @param p the dataset parameters.
+   * @returns the plane.
+   */
+  ome::files::VariantPixelBuffer
+  create_plane(const dataset_params& p)
+  {
+    RandomFillVisitor random_fill;
+    ome::files::VariantPixelBuffer buf(boost::extents[p.sizex][p.sizey][1][1][1][1][1][1][1],
+                                       p.pixeltype);
+    boost::apply_visitor(random_fill, buf.vbuffer());
+    return buf;
+  }
+
+  /**
+   * Write a synthetic OME-TIFF dataset.
+   *
+   * Every plane contains the same data.  The metadata and plane are
+   * created by the caller, so that only the writing is timed.
+   *
+   * @param p the dataset parameters.
+   * @param meta the dataset metadata.
+   * @param buf the pixel data for each plane.
+   * @param outfile the file to write.
+   */
+  void
+  write_dataset(const dataset_params& p,
+                std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta,
+                ome::files::VariantPixelBuffer& buf,
+                const boost::filesystem::path& outfile)
+  {
+    std::shared_ptr< ::ome::xml::meta::MetadataRetrieve> retrieve(meta);
+
+    if(boost::filesystem::exists(outfile))
+      boost::filesystem::remove(outfile);
+
+    std::unique_ptr<ome::files::out::OMETIFFWriter> writer = std::make_unique<ome::files::out::OMETIFFWriter>();
+    writer->setMetadataRetrieve(retrieve);
+    writer->setInterleaved(false);
+    writer->setBigTIFF(true);
+    if (p.tilesize)
+      {
+        writer->setTileSizeX(p.tilesize);
+        writer->setTileSizeY(p.tilesize);
+      }
+    writer->setId(outfile);
+
+    for (dimension_size_type series = 0; series < p.series; ++series)
+      {
+        writer->setSeries(series);
+        for (dimension_size_type plane = 0;
+             plane < p.sizez * p.sizec * p.sizet;
+             ++plane)
+          {
+            writer->setPlane(plane);
+            writer->saveBytes(plane, buf);
+          }
+      }
+    writer->close();
+  }
+
+  /**
+   * Read back a dataset, recording the metadata and pixeldata timings.
+   *
+   * @param infile the file to read.
+   * @param desc the dataset description.
+   * @param results the result stream.
+   * @returns the size of the OME-XML metadata.
+   */
+  std::string::size_type
+  read_dataset(const boost::filesystem::path& infile,
+               const std::string& desc,
+               std::ostream& results)
+  {
+    timepoint meta_start;
+    std::string omexml = read_omexml(infile);
+    ome::files::createOMEXMLMetadata(omexml);
+    timepoint meta_end;
+
+    result(results, "metadata.read", desc, meta_start, meta_end);
+
+    timepoint read_start;
+    timepoint read_init;
+
+    {
+      ome::files::in::OMETIFFReader reader;
+      reader.setMetadataStore(std::make_shared<ome::xml::meta::OMEXMLMetadata>());
+      reader.setId(infile);
+
+      read_init = timepoint();
+
+      ome::files::VariantPixelBuffer buf;
+      for (dimension_size_type series = 0;
+           series < reader.getSeriesCount();
+           ++series)
+        {
+          reader.setSeries(series);
+          buf.setBuffer(boost::extents[1][1][1][1][1][1][1][1][1],
+                        reader.getPixelType(),
+                        ome::files::PixelBufferBase::make_storage_order(reader.getDimensionOrder(), reader.isInterleaved()));
+          for (dimension_size_type plane = 0;
+               plane < reader.getImageCount();
+               ++plane)
+            {
+              reader.setPlane(plane);
+              reader.openBytes(plane, buf);
+            }
+        }
+    }
+
+    timepoint read_end;
+
+    result(results, "pixeldata.read", desc, read_start, read_end);
+    result(results, "pixeldata.read.init", desc, read_start, read_init);
+    result(results, "pixeldata.read.pixels", desc, read_init, read_end);
+
+    return omexml.size();
+  }
+
+  dataset_params
+  parse_params(char *argv[])
+  {
+    return dataset_params {std::strtoul(argv[0], nullptr, 10),
+        std::strtoul(argv[1], nullptr, 10),
+        std::strtoul(argv[2], nullptr, 10),
+        std::strtoul(argv[3], nullptr, 10),
+        std::strtoul(argv[4], nullptr, 10),
+        std::strtoul(argv[5], nullptr, 10),
+        PixelType(std::string(argv[6])),
+        std::strtoul(argv[7], nullptr, 10),
+        std::strtoul(argv[8], nullptr, 10),
+        std::strtoul(argv[9], nullptr, 10)};
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  std::string mode(argc > 1 ? argv[1] : "");
+
+  if (!((mode == "generate" && argc == 13) ||
+        (mode == "sweep" && argc == 20)))
+    {
+      std::cerr << "Usage: " << argv[0] << " generate sizex sizey sizez sizec sizet series pixeltype tilesize annotations rois outputfile\n"
+                << "       " << argv[0] << " sweep axis start end step iterations sizex sizey sizez sizec sizet series pixeltype tilesize annotations rois outputfileprefix resultfile scalingfile\n"
+                << "\n"
+                << "Sweep axes: sizex sizey plane sizez sizec sizet series tilesize annotations rois\n"
+                << "A step of the form *N multiplies the value by N at each step.\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      if (mode == "generate")
+        {
+          dataset_params p = parse_params(argv + 2);
+          boost::filesystem::path outfile(argv[12]);
+
+          std::cout << "Generating " << describe(p) << "..." << std::flush;
+          ome::files::VariantPixelBuffer buf(create_plane(p));
+          write_dataset(p, create_metadata(p), buf, outfile);
+          std::cout << "done\n" << std::flush;
+          return 0;
+        }
+
+      std::string axis(argv[2]);
+      dimension_size_type start = std::strtoul(argv[3], nullptr, 10);
+      dimension_size_type end = std::strtoul(argv[4], nullptr, 10);
+      std::string stepspec(argv[5]);
+      int iterations = std::atoi(argv[6]);
+      dataset_params base = parse_params(argv + 7);
+      std::string outfileprefix(argv[17]);
+      boost::filesystem::path resultfile(argv[18]);
+      boost::filesystem::path scalingfile(argv[19]);
+
+      bool geometric = !stepspec.empty() && stepspec[0] == '*';
+      dimension_size_type step = std::strtoul(stepspec.c_str() + (geometric ? 1 : 0), nullptr, 10);
+      if (step == 0 || (geometric && (step == 1 || start == 0)))
+        {
+          std::cerr << "Invalid sweep step: " << stepspec << '\n';
+          std::exit(1);
+        }
+
+      std::ofstream results(resultfile.string().c_str());
+      std::ofstream scaling(scalingfile.string().c_str());
+
+      result_header(results);
+      extra_result_header(scaling,
+                          {{"sweep.axis"}, {"sweep.value"}, {"iteration"},
+                           {"series"}, {"planes"}, {"filesize"}, {"metadatasize"}});
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          for (dimension_size_type value = start;
+               value <= end;
+               value = geometric ? value * step : value + step)
+            {
+              dataset_params p(base);
+              set_axis(p, axis, value);
+              std::string desc = describe(p);
+              boost::filesystem::path outfile(outfileprefix + '-' + desc + ".ome.tiff");
+
+              std::cout << "TEST: [" << i << "] " << axis << '=' << value << ": " << desc << std::endl;
+
+              std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta(create_metadata(p));
+              ome::files::VariantPixelBuffer buf(create_plane(p));
+
+              timepoint write_start;
+              write_dataset(p, meta, buf, outfile);
+              timepoint write_end;
+
+              result(results, "pixeldata.write", desc, write_start, write_end);
+
+              std::string::size_type metadatasize = read_dataset(outfile, desc, results);
+
+              extra_result(scaling, "generate", desc,
+                           axis, value, i,
+                           p.series, p.series * p.sizez * p.sizec * p.sizet,
+                           boost::filesystem::file_size(outfile), metadatasize);
+
+              boost::filesystem::remove(outfile);
+            }
+        }
+
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
@@ -0,0 +1,223 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "dataset-index.h"
+#include "result.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/compat/array.h>
+#include <ome/common/log.h>
+
+#include <ome/files/MetadataTools.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/in/OMETIFFReader.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/tiff/TIFF.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+int main(int argc, char *argv[])
+{
+  if (argc != 5)
+    {
+      std::cerr << "Usage: " << argv[0] << " iterations inputfile cachefile resultfile\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      int iterations = std::atoi(argv[1]);
+      boost::filesystem::path infile(argv[2]);
+      boost::filesystem::path cachefile(argv[3]);
+      boost::filesystem::path resultfile(argv[4]);
+
+      std::ofstream results(resultfile.string().c_str());
+
+      result_header(results);
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          boost::filesystem::remove(cachefile);
+
+          // Cold initialisation: full OME-XML parse and IFD walk by the reader.
+          timepoint cold_start;
+          timepoint cold_init;
+
+          {
+            std::cout << "pass " << i << ": cold read init..." << std::flush;
+            ome::files::in::OMETIFFReader reader;
+            reader.setMetadataStore(std::make_shared<ome::xml::meta::OMEXMLMetadata>());
+            reader.setId(infile);
+            std::cout << "done\n" << std::flush;
+
+            cold_init = timepoint();
+
+            std::cout << "pass " << i << ": cold read pixels..." << std::flush;
+            ome::files::VariantPixelBuffer buf;
+            for (ome::files::dimension_size_type series = 0;
+                 series < reader.getSeriesCount();
+                 ++series)
+              {
+                reader.setSeries(series);
+                buf.setBuffer(boost::extents[1][1][1][1][1][1][1][1][1],
+                              reader.getPixelType(),
+                              ome::files::PixelBufferBase::make_storage_order(reader.getDimensionOrder(), reader.isInterleaved()));
+                for (ome::files::dimension_size_type plane = 0;
+                     plane < reader.getImageCount();
+                     ++plane)
+                  {
+                    reader.setPlane(plane);
+                    reader.openBytes(plane, buf);
+                  }
+              }
+            std::cout << "done\n" << std::flush;
+          }
+
+          timepoint cold_end;
+
+          result(results, "pixeldata.read.cold", infile, cold_start, cold_end);
+          result(results, "pixeldata.read.cold.init", infile, cold_start, cold_init);
+          result(results, "pixeldata.read.cold.pixels", infile, cold_init, cold_end);
+
+          // Uncached direct initialisation: the same work as creating
+          // the index, without writing the cache.  This is the
+          // baseline for the cached initialisation below.
+          timepoint uncached_start;
+          timepoint uncached_init;
+
+          {
+            std::cout << "pass " << i << ": uncached read init..." << std::flush;
+            std::string omexml = read_omexml(infile);
+            std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta = ome::files::createOMEXMLMetadata(omexml);
+            dataset_index index = build_index(*meta, infile);
+
+            std::vector<std::shared_ptr<ome::files::tiff::TIFF>> tiffs;
+            for (auto& file : index.files)
+              {
+                tiffs.push_back(ome::files::tiff::TIFF::open(file.path, "r"));
+                index_file(file, *tiffs.back());
+              }
+            std::cout << "done\n" << std::flush;
+
+            uncached_init = timepoint();
+
+            std::cout << "pass " << i << ": uncached read pixels..." << std::flush;
+            ome::files::VariantPixelBuffer buf;
+            for (const auto& series : index.series)
+              for (const auto& location : series.planes)
+                plane_ifd(index, tiffs, location)->readImage(buf);
+            std::cout << "done\n" << std::flush;
+          }
+
+          timepoint uncached_end;
+
+          result(results, "pixeldata.read.uncached", infile, uncached_start, uncached_end);
+          result(results, "pixeldata.read.uncached.init", infile, uncached_start, uncached_init);
+          result(results, "pixeldata.read.uncached.pixels", infile, uncached_init, uncached_end);
+
+          // Index creation: this is a one-off cost when the cache is
+          // missing or stale.
+          timepoint cache_start;
+
+          {
+            std::cout << "pass " << i << ": write cache..." << std::flush;
+            bool cached;
+            load_index(infile, cachefile, cached);
+            if (cached)
+              throw std::logic_error("Cache unexpectedly present");
+            std::cout << "done\n" << std::flush;
+          }
+
+          timepoint cache_end;
+
+          result(results, "metadata.cache.write", infile, cache_start, cache_end);
+
+          // Cached initialisation: load the index and open the files.
+          timepoint cached_start;
+          timepoint cached_init;
+
+          {
+            std::cout << "pass " << i << ": cached read init..." << std::flush;
+            bool cached;
+            dataset_index index = load_index(infile, cachefile, cached);
+            if (!cached)
+              throw std::runtime_error("Failed to load index cache " + cachefile.string());
+
+            std::vector<std::shared_ptr<ome::files::tiff::TIFF>> tiffs;
+            for (const auto& file : index.files)
+              tiffs.push_back(ome::files::tiff::TIFF::open(file.path, "r"));
+            std::cout << "done\n" << std::flush;
+
+            cached_init = timepoint();
+
+            std::cout << "pass " << i << ": cached read pixels..." << std::flush;
+            ome::files::VariantPixelBuffer buf;
+            for (const auto& series : index.series)
+              for (const auto& location : series.planes)
+                plane_ifd(index, tiffs, location)->readImage(buf);
+            std::cout << "done\n" << std::flush;
+          }
+
+          timepoint cached_end;
+
+          result(results, "pixeldata.read.cached", infile, cached_start, cached_end);
+          result(results, "pixeldata.read.cached.init", infile, cached_start, cached_init);
+          result(results, "pixeldata.read.cached.pixels", infile, cached_init, cached_end);
+        }
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
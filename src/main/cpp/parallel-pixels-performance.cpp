@@ -0,0 +1,202 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "dataset-index.h"
+#include "result.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/common/log.h>
+
+#include <ome/files/MetadataTools.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/tiff/TIFF.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+namespace
+{
+
+  /**
+   * Run a task for each item using a fixed number of placed threads.
+   *
+   * Items are handed out dynamically, so that threads finishing
+   * early take on the remaining work.
+   *
+   * @param threads the number of threads to use.
+   * @param policy the thread placement policy.
+   * @param count the number of items.
+   * @param task the task to run for each item index.
+   */
+  template<typename Task>
+  void
+  parallel_for(unsigned int threads,
+               placement_policy policy,
+               std::size_t count,
+               Task task)
+  {
+    std::atomic<std::size_t> next(0);
+    run_threads(threads, policy,
+                [&](unsigned int)
+                {
+                  for (std::size_t item = next++; item < count; item = next++)
+                    task(item);
+                });
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 6 && argc != 7)
+    {
+      std::cerr << "Usage: " << argv[0] << " iterations maxthreads inputfile resultfile scalingfile [none|compact|scatter|node|interleave]\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      int iterations = std::atoi(argv[1]);
+      unsigned int maxthreads = std::strtoul(argv[2], nullptr, 10);
+      boost::filesystem::path infile(argv[3]);
+      boost::filesystem::path resultfile(argv[4]);
+      boost::filesystem::path scalingfile(argv[5]);
+      placement_policy policy = parse_placement(argc == 7 ? argv[6] : "none");
+
+      std::ofstream results(resultfile.string().c_str());
+      std::ofstream scaling(scalingfile.string().c_str());
+
+      scaling_result_header(results);
+      extra_result_header(scaling,
+                          {{"placement"}, {"threads"}, {"iteration"}, {"files"}, {"planes"},
+                           {"init"}, {"init.speedup"}, {"init.efficiency"}});
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          dataset_index index;
+          std::vector<std::shared_ptr<ome::files::tiff::TIFF>> tiffs;
+          std::vector<std::vector<plane_location>> file_planes;
+          std::atomic<std::size_t> next_file(0);
+          double init_baseline = 0.0;
+
+          // Initialisation is repeated, untimed by the harness, before
+          // each pixeldata scaling run, so that the pixeldata is read
+          // from newly opened files.
+          auto init = [&](unsigned int threads)
+            {
+              timepoint init_start;
+
+              // The metadata in the first file lists all the other
+              // files, so it must be parsed before they are opened.
+              std::cout << "pass " << i << ": " << threads << " threads: read init..." << std::flush;
+              std::string omexml = read_omexml(infile);
+              std::shared_ptr<ome::xml::meta::OMEXMLMetadata> meta = ome::files::createOMEXMLMetadata(omexml);
+              index = build_index(*meta, infile);
+
+              // Open and index the component files concurrently.
+              tiffs.clear();
+              tiffs.resize(index.files.size());
+              parallel_for(threads, policy, index.files.size(),
+                           [&](std::size_t f)
+                           {
+                             tiffs.at(f) = ome::files::tiff::TIFF::open(index.files.at(f).path, "r");
+                             index_file(index.files.at(f), *tiffs.at(f));
+                           });
+              std::cout << "done\n" << std::flush;
+
+              timepoint init_end;
+
+              // Group the planes by file; each TIFF is only used by a
+              // single thread at a time, since TIFF handles are not
+              // thread-safe.  Planes in different files are read in
+              // parallel.
+              std::size_t planecount = 0;
+              file_planes.clear();
+              file_planes.resize(index.files.size());
+              for (const auto& series : index.series)
+                for (const auto& location : series.planes)
+                  {
+                    file_planes.at(location.file).push_back(location);
+                    ++planecount;
+                  }
+              next_file = 0;
+
+              double real = elapsed_real(init_start, init_end);
+              if (threads == 1)
+                init_baseline = real;
+              double speedup = real > 0.0 ? init_baseline / real : 0.0;
+
+              extra_result(scaling, "pixeldata.read.parallel.init", infile,
+                           placement_name(policy), threads, i,
+                           index.files.size(), planecount,
+                           real, speedup, speedup / threads);
+            };
+
+          auto read_pixels = [&](unsigned int, unsigned int)
+            {
+              ome::files::VariantPixelBuffer buf;
+              for (std::size_t f = next_file++; f < file_planes.size(); f = next_file++)
+                for (const auto& location : file_planes.at(f))
+                  plane_ifd(index, tiffs, location)->readImage(buf);
+            };
+
+          run_scaling(results, "pixeldata.read.parallel.pixels", infile,
+                      maxthreads, policy, read_pixels, init);
+        }
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
@@ -37,6 +37,7 @@
  */
 
 #include "result.h"
+#include "write-behind.h"
 
 #include <cstdlib>
 #include <fstream>
@@ -44,6 +45,7 @@
 #include <memory>
 #include <vector>
 
+#include <boost/chrono/system_clocks.hpp>
 #include <boost/filesystem.hpp>
 
 #include <ome/compat/array.h>
@@ -58,9 +60,9 @@
 
 int main(int argc, char *argv[])
 {
-  if (argc != 5)
+  if (argc != 5 && argc != 7)
     {
-      std::cerr << "Usage: " << argv[0] << " iterations inputfile outputfile resultfile\n";
+      std::cerr << "Usage: " << argv[0] << " iterations inputfile outputfile resultfile [sync|behind stallfile]\n";
       std::exit(1);
     }
 
@@ -73,9 +75,26 @@ int main(int argc, char *argv[])
       boost::filesystem::path outfile(argv[3]);
       boost::filesystem::path resultfile(argv[4]);
 
+      bool behind = false;
+      std::ofstream stalls;
+      if (argc == 7)
+        {
+          std::string modename(argv[5]);
+          if (modename == "behind")
+            behind = true;
+          else if (modename != "sync")
+            {
+              std::cerr << "Invalid write mode: " << modename << '\n';
+              std::exit(1);
+            }
+          stalls.open(argv[6]);
+        }
+
       std::ofstream results(resultfile.string().c_str());
 
       result_header(results);
+      if (stalls.is_open())
+        extra_result_header(stalls, {{"write.mode"}, {"planes"}, {"stall"}});
 
       for(int i = 0; i < iterations; ++i)
         {
@@ -159,28 +178,97 @@ int main(int argc, char *argv[])
 
             write_init = timepoint();
 
-            for (ome::files::dimension_size_type series = 0;
-                 series < pixels.size();
-                 ++series)
-              {
-                std::cout << "pass " << i << ": write series " << series << ": " << std::flush;
-                writer->setInterleaved(interleaved.at(series));
-                writer->setSeries(series);
-
-                std::vector<std::unique_ptr<ome::files::VariantPixelBuffer> >& planes = pixels.at(series);
+            // Time the producer spent blocked waiting for writes.
+            boost::chrono::steady_clock::duration stall(0);
+            ome::files::dimension_size_type plane_count = 0;
 
-                for (ome::files::dimension_size_type plane = 0;
-                     plane < planes.size();
-                     ++plane)
+            if (!behind)
+              {
+                for (ome::files::dimension_size_type series = 0;
+                     series < pixels.size();
+                     ++series)
                   {
-                    writer->setPlane(plane);
-
-                    std::unique_ptr<ome::files::VariantPixelBuffer>& buf = planes.at(plane);
-                    writer->saveBytes(plane, *buf);
-                    std::cout << '.' << std::flush;
+                    std::cout << "pass " << i << ": write series " << series << ": " << std::flush;
+                    writer->setInterleaved(interleaved.at(series));
+                    writer->setSeries(series);
+
+                    std::vector<std::unique_ptr<ome::files::VariantPixelBuffer> >& planes = pixels.at(series);
+
+                    for (ome::files::dimension_size_type plane = 0;
+                         plane < planes.size();
+                         ++plane)
+                      {
+                        writer->setPlane(plane);
+
+                        std::unique_ptr<ome::files::VariantPixelBuffer>& buf = planes.at(plane);
+                        auto stall_start = boost::chrono::steady_clock::now();
+                        writer->saveBytes(plane, *buf);
+                        stall += boost::chrono::steady_clock::now() - stall_start;
+                        ++plane_count;
+                        std::cout << '.' << std::flush;
+                      }
+                    std::cout << " done\n" << std::flush;
                   }
-                std::cout << " done\n" << std::flush;
               }
+            else
+              {
+                // Each plane is copied into one of two staging buffers
+                // to model its production, while the previous plane is
+                // written by the I/O thread.  All writer calls are made
+                // on the I/O thread, in order.
+                std::unique_ptr<ome::files::VariantPixelBuffer> staging[2];
+                unsigned int current = 0;
+                write_behind queue(1);
+
+                for (ome::files::dimension_size_type series = 0;
+                     series < pixels.size();
+                     ++series)
+                  {
+                    std::cout << "pass " << i << ": write series " << series << ": " << std::flush;
+                    bool series_interleaved = interleaved.at(series);
+                    // This blocks until the last plane of the previous
+                    // series is written, so counts as stall time.
+                    auto series_stall_start = boost::chrono::steady_clock::now();
+                    queue.submit([&writer, series, series_interleaved]()
+                                 {
+                                   writer->setInterleaved(series_interleaved);
+                                   writer->setSeries(series);
+                                 });
+                    stall += boost::chrono::steady_clock::now() - series_stall_start;
+
+                    std::vector<std::unique_ptr<ome::files::VariantPixelBuffer> >& planes = pixels.at(series);
+
+                    for (ome::files::dimension_size_type plane = 0;
+                         plane < planes.size();
+                         ++plane)
+                      {
+                        std::unique_ptr<ome::files::VariantPixelBuffer>& buf = staging[current];
+                        buf = std::make_unique<ome::files::VariantPixelBuffer>(*planes.at(plane));
+                        ome::files::VariantPixelBuffer *staged = buf.get();
+
+                        auto stall_start = boost::chrono::steady_clock::now();
+                        queue.submit([&writer, plane, staged]()
+                                     {
+                                       writer->setPlane(plane);
+                                       writer->saveBytes(plane, *staged);
+                                     });
+                        stall += boost::chrono::steady_clock::now() - stall_start;
+                        current = 1 - current;
+                        ++plane_count;
+                        std::cout << '.' << std::flush;
+                      }
+                    std::cout << " done\n" << std::flush;
+                  }
+
+                auto stall_start = boost::chrono::steady_clock::now();
+                queue.wait();
+                stall += boost::chrono::steady_clock::now() - stall_start;
+              }
+
+            if (stalls.is_open())
+              extra_result(stalls, "pixeldata.write.pixels", infile,
+                           behind ? "behind" : "sync", plane_count,
+                           boost::chrono::duration_cast<boost::chrono::milliseconds>(stall).count());
             close_start = timepoint();
             writer->close();
           }
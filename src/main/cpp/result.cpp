@@ -38,6 +38,279 @@
 
 #include "result.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+
+  /**
+   * A logical CPU and its position in the system topology.
+   */
+  struct cpu_info
+  {
+    unsigned int id;
+    unsigned int package;
+    unsigned int core;
+    unsigned int node;
+  };
+
+  /**
+   * Parse a CPU list such as "0-3,8,10-11".
+   */
+  std::vector<unsigned int>
+  parse_cpu_list(const std::string& list)
+  {
+    std::vector<unsigned int> cpus;
+    std::istringstream is(list);
+    std::string range;
+    while (std::getline(is, range, ','))
+      {
+        if (range.empty())
+          continue;
+        std::string::size_type dash = range.find('-');
+        unsigned int first = std::stoul(range.substr(0, dash));
+        unsigned int last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+        for (unsigned int cpu = first; cpu <= last; ++cpu)
+          cpus.push_back(cpu);
+      }
+    return cpus;
+  }
+
+  /**
+   * Read a single line from a file.
+   *
+   * @returns the line, or an empty string if the file is not readable.
+   */
+  std::string
+  read_line(const std::string& file)
+  {
+    std::ifstream in(file.c_str());
+    std::string line;
+    std::getline(in, line);
+    return line;
+  }
+
+  /**
+   * Get the online CPUs and their topology from sysfs.  Only the CPUs
+   * the process is allowed to run on are included, so that placement
+   * respects any restricted cpuset (for example, in a container).  If
+   * the topology is not available, all CPUs are assumed to be in a
+   * single package and NUMA node.
+   */
+  std::vector<cpu_info>
+  cpu_topology()
+  {
+    const std::string sys("/sys/devices/system/");
+
+    std::vector<unsigned int> online = parse_cpu_list(read_line(sys + "cpu/online"));
+    if (online.empty())
+      for (unsigned int cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1U); ++cpu)
+        online.push_back(cpu);
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+      online.erase(std::remove_if(online.begin(), online.end(),
+                                  [&allowed](unsigned int cpu)
+                                  {
+                                    return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed);
+                                  }),
+                   online.end());
+#endif
+
+    std::map<unsigned int, unsigned int> nodes;
+    for (unsigned int node : parse_cpu_list(read_line(sys + "node/online")))
+      for (unsigned int cpu : parse_cpu_list(read_line(sys + "node/node" + std::to_string(node) + "/cpulist")))
+        nodes[cpu] = node;
+
+    std::vector<cpu_info> cpus;
+    for (unsigned int cpu : online)
+      {
+        std::string topology(sys + "cpu/cpu" + std::to_string(cpu) + "/topology/");
+        std::string package(read_line(topology + "physical_package_id"));
+        std::string core(read_line(topology + "core_id"));
+        cpus.push_back(cpu_info{cpu,
+              package.empty() ? 0U : static_cast<unsigned int>(std::stoul(package)),
+              core.empty() ? cpu : static_cast<unsigned int>(std::stoul(core)),
+              nodes.count(cpu) ? nodes[cpu] : 0U});
+      }
+    return cpus;
+  }
+
+  /**
+   * Order CPUs so that each physical core appears once before any of
+   * its hyperthread siblings, round-robin over the groups given by
+   * the group key.
+   */
+  template<typename Key>
+  std::vector<cpu_info>
+  scatter_order(const std::vector<cpu_info>& cpus,
+                Key key)
+  {
+    std::map<unsigned int, std::vector<cpu_info>> groups;
+    for (const auto& cpu : cpus)
+      groups[key(cpu)].push_back(cpu);
+
+    // Within each group, the first CPU of every core comes first.
+    for (auto& group : groups)
+      {
+        std::vector<cpu_info> first;
+        std::vector<cpu_info> siblings;
+        std::set<std::pair<unsigned int, unsigned int>> seen;
+        for (const auto& cpu : group.second)
+          {
+            if (seen.insert(std::make_pair(cpu.package, cpu.core)).second)
+              first.push_back(cpu);
+            else
+              siblings.push_back(cpu);
+          }
+        first.insert(first.end(), siblings.begin(), siblings.end());
+        group.second = first;
+      }
+
+    std::vector<cpu_info> ordered;
+    for (std::size_t i = 0; ordered.size() < cpus.size(); ++i)
+      for (const auto& group : groups)
+        if (i < group.second.size())
+          ordered.push_back(group.second[i]);
+    return ordered;
+  }
+
+#ifdef __linux__
+  /**
+   * Interleave memory allocations over the NUMA nodes of the CPUs the
+   * process may run on, for the lifetime of this object.  The memory
+   * policy is that of the calling thread, and is inherited by the
+   * threads it creates.  The previous policy (for example, one set by
+   * numactl) is restored on destruction.
+   */
+  class interleave_guard
+  {
+  public:
+    /**
+     * Constructor.
+     *
+     * @param interleave @c true to interleave, or @c false to leave
+     * the memory policy unchanged.
+     */
+    explicit
+    interleave_guard(bool interleave):
+      active(false),
+      mode(MPOL_DEFAULT),
+      nodes(maxnode / (sizeof(unsigned long) * 8), 0UL)
+    {
+      if (!interleave)
+        return;
+
+      if (syscall(SYS_get_mempolicy, &mode, nodes.data(), maxnode, nullptr, 0UL) != 0)
+        throw std::runtime_error(std::string("Failed to get memory policy: ") + std::strerror(errno));
+
+      std::set<unsigned int> cpu_nodes;
+      for (const auto& cpu : cpu_topology())
+        cpu_nodes.insert(cpu.node);
+
+      std::vector<unsigned long> mask(nodes.size(), 0UL);
+      for (unsigned int node : cpu_nodes)
+        if (node < maxnode)
+          mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+
+      if (syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, mask.data(), maxnode) != 0)
+        throw std::runtime_error(std::string("Failed to set memory policy: ") + std::strerror(errno));
+      active = true;
+    }
+
+    /// Destructor.  Restores the previous memory policy.
+    ~interleave_guard()
+    {
+      // The policy was readable and settable on construction, so
+      // failure is not expected here, and cannot be reported.
+      if (active)
+        syscall(SYS_set_mempolicy, mode,
+                mode == MPOL_DEFAULT ? nullptr : nodes.data(),
+                mode == MPOL_DEFAULT ? 0UL : maxnode);
+    }
+
+    interleave_guard(const interleave_guard&) = delete;
+    interleave_guard& operator=(const interleave_guard&) = delete;
+
+  private:
+    /// Size of the node masks in bits; at least the kernel's maximum.
+    static const unsigned long maxnode = 4096;
+
+    bool active;
+    int mode;
+    std::vector<unsigned long> nodes;
+  };
+#endif
+
+}
+
+double
+elapsed_real(const timepoint& start,
+             const timepoint& end)
+{
+  return boost::chrono::duration_cast<cpu_clock_milliseconds>(end.process - start.process).count().real;
+}
+
+io_counters::io_counters():
+  rchar(0),
+  wchar(0),
+  read_bytes(0),
+  write_bytes(0)
+{
+  // Only available on Linux; elsewhere the counters remain zero.
+  std::ifstream io("/proc/self/io");
+  std::string key;
+  std::uint64_t value;
+  while (io >> key >> value)
+    {
+      if (key == "rchar:")
+        rchar = value;
+      else if (key == "wchar:")
+        wchar = value;
+      else if (key == "read_bytes:")
+        read_bytes = value;
+      else if (key == "write_bytes:")
+        write_bytes = value;
+    }
+}
+
+void
+drop_page_cache(const boost::filesystem::path& file)
+{
+#ifndef _WIN32
+  int fd = open(file.string().c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#endif
+}
+
 void
 result_header(std::ostream& os)
 {
@@ -74,3 +347,212 @@ result(std::ostream& os,
      << boost::chrono::duration_cast<cpu_clock_milliseconds>(end.process - start.process).count().system // process system time
      << '\n';
 }
+
+placement_policy
+parse_placement(const std::string& name)
+{
+  if (name == "none")
+    return PLACE_NONE;
+  if (name == "compact")
+    return PLACE_COMPACT;
+  if (name == "scatter")
+    return PLACE_SCATTER;
+  if (name == "node")
+    return PLACE_NODE;
+  if (name == "interleave")
+    return PLACE_INTERLEAVE;
+  throw std::runtime_error("Invalid placement policy: " + name);
+}
+
+std::string
+placement_name(placement_policy policy)
+{
+  switch(policy)
+    {
+    case PLACE_COMPACT:
+      return "compact";
+    case PLACE_SCATTER:
+      return "scatter";
+    case PLACE_NODE:
+      return "node";
+    case PLACE_INTERLEAVE:
+      return "interleave";
+    case PLACE_NONE:
+    default:
+      return "none";
+    }
+}
+
+std::vector<unsigned int>
+placement_cpus(placement_policy policy,
+               unsigned int threads)
+{
+  std::vector<unsigned int> placement;
+
+#ifdef __linux__
+  if (policy == PLACE_NONE)
+    return placement;
+
+  std::vector<cpu_info> cpus = cpu_topology();
+  std::vector<cpu_info> ordered;
+
+  switch(policy)
+    {
+    case PLACE_COMPACT:
+    case PLACE_NODE:
+      ordered = cpus;
+      std::sort(ordered.begin(), ordered.end(),
+                [](const cpu_info& lhs, const cpu_info& rhs)
+                {
+                  return std::make_tuple(lhs.node, lhs.package, lhs.core, lhs.id) <
+                    std::make_tuple(rhs.node, rhs.package, rhs.core, rhs.id);
+                });
+      if (policy == PLACE_NODE)
+        {
+          unsigned int node = ordered.front().node;
+          ordered.erase(std::remove_if(ordered.begin(), ordered.end(),
+                                       [node](const cpu_info& cpu) { return cpu.node != node; }),
+                        ordered.end());
+        }
+      break;
+    case PLACE_SCATTER:
+    case PLACE_INTERLEAVE:
+    default:
+      ordered = scatter_order(cpus, [](const cpu_info& cpu) { return cpu.package; });
+      break;
+    }
+
+  for (unsigned int t = 0; t < threads && !ordered.empty(); ++t)
+    placement.push_back(ordered.at(t % ordered.size()).id);
+#else
+  static_cast<void>(policy);
+  static_cast<void>(threads);
+#endif
+
+  return placement;
+}
+
+std::string
+run_threads(unsigned int threads,
+            placement_policy policy,
+            const std::function<void(unsigned int)>& body)
+{
+  std::vector<unsigned int> cpus = placement_cpus(policy, threads);
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+
+#ifdef __linux__
+  interleave_guard interleave(policy == PLACE_INTERLEAVE);
+#endif
+
+  // If a thread cannot be created, the threads already started must
+  // be joined before unwinding.
+  auto join = [&workers]()
+    {
+      for (auto& worker : workers)
+        if (worker.joinable())
+          worker.join();
+    };
+
+  try
+    {
+      for (unsigned int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]()
+                             {
+                               try
+                                 {
+#ifdef __linux__
+                                   // Pin before running the body, so that
+                                   // no work is done on another CPU.
+                                   if (!cpus.empty())
+                                     {
+                                       cpu_set_t set;
+                                       CPU_ZERO(&set);
+                                       CPU_SET(cpus.at(t), &set);
+                                       int status = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                                       if (status != 0)
+                                         throw std::runtime_error("Failed to pin thread to CPU " +
+                                                                  std::to_string(cpus.at(t)) + ": " +
+                                                                  std::strerror(status));
+                                     }
+#endif
+                                   body(t);
+                                 }
+                               catch (...)
+                                 {
+                                   errors.at(t) = std::current_exception();
+                                 }
+                             });
+    }
+  catch (...)
+    {
+      join();
+      throw;
+    }
+  join();
+
+  for (const auto& error : errors)
+    if (error)
+      std::rethrow_exception(error);
+
+  if (cpus.empty())
+    return "-";
+
+  std::ostringstream list;
+  for (std::size_t t = 0; t < cpus.size(); ++t)
+    list << (t ? "," : "") << cpus.at(t);
+  return list.str();
+}
+
+void
+scaling_result_header(std::ostream& os)
+{
+  os << "test.lang\ttest.name\ttest.file\tplacement\tthreads\tcpus\tproc.real\tproc.user\tproc.system\tspeedup\tefficiency"
+     << std::endl;
+}
+
+void
+run_scaling(std::ostream& os,
+            const std::string& testname,
+            const boost::filesystem::path& testfile,
+            unsigned int maxthreads,
+            placement_policy policy,
+            const std::function<void(unsigned int, unsigned int)>& body,
+            const std::function<void(unsigned int)>& setup)
+{
+  double baseline = 0.0;
+
+  for (unsigned int threads = 1; threads <= maxthreads; ++threads)
+    {
+      if (setup)
+        setup(threads);
+
+      timepoint start;
+      std::string cpus = run_threads(threads, policy,
+                                     [&body, threads](unsigned int thread)
+                                     {
+                                       body(thread, threads);
+                                     });
+      timepoint end;
+
+      double real = elapsed_real(start, end);
+      if (threads == 1)
+        baseline = real;
+      double speedup = real > 0.0 ? baseline / real : 0.0;
+
+      auto times = boost::chrono::duration_cast<cpu_clock_milliseconds>(end.process - start.process).count();
+
+      os << "C++"
+         << '\t' << testname
+         << '\t' << testfile.filename().string()
+         << '\t' << placement_name(policy)
+         << '\t' << threads
+         << '\t' << cpus
+         << '\t' << times.real
+         << '\t' << times.user
+         << '\t' << times.system
+         << '\t' << speedup
+         << '\t' << speedup / threads
+         << '\n';
+    }
+}
@@ -50,6 +50,11 @@ typedef boost::chrono::duration<boost::chrono::process_times<boost::chrono::mill
 
 #include <boost/filesystem/path.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
 /**
  * The various time measurements being recorded.  This is used to
  * record a single point in time; the difference between two
@@ -64,6 +69,48 @@ struct timepoint
   boost::chrono::process_cpu_clock::time_point process;
 };
 
+/**
+ * Elapsed real time between two timepoints.
+ *
+ * @param start the start timepoint.
+ * @param end the end timepoint.
+ * @returns the elapsed time in milliseconds.
+ */
+double
+elapsed_real(const timepoint& start,
+             const timepoint& end);
+
+/**
+ * Process I/O counters.  These are the cumulative totals for the
+ * process, so the difference between two snapshots will give the I/O
+ * performed by a test.  On platforms where the counters are not
+ * available, all values will be zero.
+ */
+struct io_counters
+{
+  io_counters();
+
+  /// Bytes requested by read system calls (including cached reads).
+  std::uint64_t rchar;
+  /// Bytes requested by write system calls.
+  std::uint64_t wchar;
+  /// Bytes fetched from the storage layer.
+  std::uint64_t read_bytes;
+  /// Bytes sent to the storage layer.
+  std::uint64_t write_bytes;
+};
+
+/**
+ * Drop the cached pages of a file, so that later reads are fetched
+ * from the storage layer and counted in io_counters::read_bytes.
+ * Pages currently mapped by the process are not dropped.  On
+ * platforms without posix_fadvise, this does nothing.
+ *
+ * @param file the file to drop from the cache.
+ */
+void
+drop_page_cache(const boost::filesystem::path& file);
+
 /**
  * Output TSV header.
  *
@@ -122,6 +169,104 @@ extra_result(std::ostream& os,
   os << '\n';
 }
 
+/**
+ * Thread placement policy.  Pinning is only supported on Linux; on
+ * other platforms threads are never pinned.
+ */
+enum placement_policy
+  {
+    PLACE_NONE,      ///< Threads are not pinned.
+    PLACE_COMPACT,   ///< Threads fill each core, then socket, in turn.
+    PLACE_SCATTER,   ///< Threads are spread round-robin over sockets, one per core first.
+    PLACE_NODE,      ///< Threads are confined to the CPUs of the first NUMA node.
+    PLACE_INTERLEAVE ///< As for scatter, with memory interleaved over all NUMA nodes.
+  };
+
+/**
+ * Get a placement policy by name.
+ *
+ * @param name the policy name (none, compact, scatter, node or interleave).
+ * @returns the policy.
+ * @throws std::runtime_error if the name is invalid.
+ */
+placement_policy
+parse_placement(const std::string& name);
+
+/**
+ * Get the name of a placement policy.
+ *
+ * @param policy the policy.
+ * @returns the policy name.
+ */
+std::string
+placement_name(placement_policy policy);
+
+/**
+ * Get the CPU to pin each thread to.
+ *
+ * If there are more threads than CPUs available to the policy,
+ * threads wrap around to share CPUs.
+ *
+ * @param policy the placement policy.
+ * @param threads the number of threads.
+ * @returns the CPU for each thread, or an empty list if the threads
+ * are not to be pinned.
+ */
+std::vector<unsigned int>
+placement_cpus(placement_policy policy,
+               unsigned int threads);
+
+/**
+ * Run a function concurrently on a number of placed threads.
+ *
+ * Any exception thrown by the function is rethrown once all threads
+ * have finished.
+ *
+ * @param threads the number of threads.
+ * @param policy the placement policy.
+ * @param body the function to run, passed the thread index.
+ * @returns the CPUs used as a comma-separated list, or "-" if the
+ * threads were not pinned.
+ */
+std::string
+run_threads(unsigned int threads,
+            placement_policy policy,
+            const std::function<void(unsigned int)>& body);
+
+/**
+ * Output TSV scaling header.
+ *
+ * @param os the stream to use.
+ */
+void
+scaling_result_header(std::ostream& os);
+
+/**
+ * Run and output a thread scaling test.
+ *
+ * The body is run on 1 to @c maxthreads placed threads.  For each
+ * thread count, the optional setup function is called first, untimed.
+ * Each result row records the placement policy, thread count and
+ * CPUs used along with the time taken, and the speedup and parallel
+ * efficiency relative to a single thread.
+ *
+ * @param os the stream to use.
+ * @param testname the name of the test.
+ * @param testfile the input filename of the test data.
+ * @param maxthreads the maximum number of threads.
+ * @param policy the placement policy.
+ * @param body the test body, passed the thread index and thread count.
+ * @param setup the setup function, passed the thread count.
+ */
+void
+run_scaling(std::ostream& os,
+            const std::string& testname,
+            const boost::filesystem::path& testfile,
+            unsigned int maxthreads,
+            placement_policy policy,
+            const std::function<void(unsigned int, unsigned int)>& body,
+            const std::function<void(unsigned int)>& setup = nullptr);
+
 /*
  * Local Variables:
  * mode:C++
@@ -0,0 +1,295 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "result.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/compat/array.h>
+#include <ome/common/log.h>
+
+#include <ome/files/PixelProperties.h>
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/in/OMETIFFReader.h>
+
+#include <ome/xml/meta/OMEXMLMetadata.h>
+
+using ome::files::dimension_size_type;
+
+namespace
+{
+
+  enum roi_mode
+    {
+      RANDOM,  ///< Fixed-size windows at random positions.
+      SLIDING, ///< Fixed-size windows sliding over the plane with overlap.
+      ROW      ///< Single-row strips covering the full plane width.
+    };
+
+  /**
+   * Byte counts accumulated over a set of region reads.
+   */
+  struct roi_bytes
+  {
+    /// Number of regions read.
+    std::uint64_t count;
+    /// Bytes of pixel data returned to the caller.
+    std::uint64_t returned;
+    /// Bytes of pixel data in the tiles or strips touched by the regions.
+    std::uint64_t decoded;
+  };
+
+  /**
+   * Read a single region and account for the bytes it touched.
+   *
+   * The decoded size is computed from the tile (or strip) layout of
+   * the current series: every tile intersecting the region must be
+   * read and decoded in full, even if only part of it is returned.
+   */
+  void
+  read_region(const ome::files::in::OMETIFFReader& reader,
+              dimension_size_type plane,
+              ome::files::VariantPixelBuffer& buf,
+              dimension_size_type x,
+              dimension_size_type y,
+              dimension_size_type w,
+              dimension_size_type h,
+              dimension_size_type tilew,
+              dimension_size_type tileh,
+              roi_bytes& bytes)
+  {
+    reader.openBytes(plane, buf, x, y, w, h);
+
+    dimension_size_type pixelbytes = ome::files::bytesPerPixel(reader.getPixelType());
+    dimension_size_type samples = buf.num_elements() / (w * h);
+
+    dimension_size_type tilesx = ((x + w - 1) / tilew) - (x / tilew) + 1;
+    dimension_size_type tilesy = ((y + h - 1) / tileh) - (y / tileh) + 1;
+
+    ++bytes.count;
+    bytes.returned += buf.num_elements() * pixelbytes;
+    bytes.decoded += tilesx * tilesy * tilew * tileh * samples * pixelbytes;
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 8)
+    {
+      std::cerr << "Usage: " << argv[0] << " iterations random|sliding|row roisize overlap inputfile resultfile amplificationfile\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      int iterations = std::atoi(argv[1]);
+      std::string modename(argv[2]);
+      dimension_size_type roisize = std::strtoul(argv[3], nullptr, 10);
+      dimension_size_type overlap = std::strtoul(argv[4], nullptr, 10);
+      boost::filesystem::path infile(argv[5]);
+      boost::filesystem::path resultfile(argv[6]);
+      boost::filesystem::path amplificationfile(argv[7]);
+
+      roi_mode mode;
+      if (modename == "random")
+        mode = RANDOM;
+      else if (modename == "sliding")
+        mode = SLIDING;
+      else if (modename == "row")
+        mode = ROW;
+      else
+        {
+          std::cerr << "Invalid ROI mode: " << modename << '\n';
+          std::exit(1);
+        }
+
+      if (roisize == 0 || (mode == SLIDING && overlap >= roisize))
+        {
+          std::cerr << "Invalid ROI size " << roisize << " with overlap " << overlap << '\n';
+          std::exit(1);
+        }
+
+      std::string testname = "pixeldata.read.roi." + modename;
+
+      std::ofstream results(resultfile.string().c_str());
+      std::ofstream amplification(amplificationfile.string().c_str());
+
+      result_header(results);
+      extra_result_header(amplification,
+                          {{"roi.mode"}, {"roi.size"}, {"roi.overlap"},
+                           {"tile.width"}, {"tile.height"}, {"roi.count"},
+                           {"bytes.returned"}, {"bytes.decoded"},
+                           {"io.rchar"}, {"io.read_bytes"}});
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          // Fixed seed so that every pass reads the same regions.
+          std::mt19937 rng(9343);
+          roi_bytes bytes {0, 0, 0};
+          dimension_size_type tilew = 0;
+          dimension_size_type tileh = 0;
+
+          timepoint read_start;
+          timepoint read_init;
+          io_counters io_start;
+
+          {
+            std::cout << "pass " << i << ": read init..." << std::flush;
+            ome::files::in::OMETIFFReader reader;
+            reader.setMetadataStore(std::make_shared<ome::xml::meta::OMEXMLMetadata>());
+            reader.setId(infile);
+            std::cout << "done\n" << std::flush;
+
+            // Read the pixeldata from storage rather than the page
+            // cache, and count and time only the pixeldata reads.
+            for (const auto& file : reader.getUsedFiles())
+              drop_page_cache(file);
+            io_start = io_counters();
+
+            read_init = timepoint();
+
+            ome::files::VariantPixelBuffer buf;
+
+            for (dimension_size_type series = 0;
+                 series < reader.getSeriesCount();
+                 ++series)
+              {
+                std::cout << "pass " << i << ": read series " << series << ": " << std::flush;
+                reader.setSeries(series);
+
+                dimension_size_type sizex = reader.getSizeX();
+                dimension_size_type sizey = reader.getSizeY();
+                dimension_size_type w = std::min(roisize, sizex);
+                dimension_size_type h = std::min(roisize, sizey);
+                tilew = reader.getOptimalTileWidth();
+                tileh = reader.getOptimalTileHeight();
+
+                buf.setBuffer(boost::extents[1][1][1][1][1][1][1][1][1],
+                              reader.getPixelType(),
+                              ome::files::PixelBufferBase::make_storage_order(reader.getDimensionOrder(), reader.isInterleaved()));
+
+                for (dimension_size_type plane = 0;
+                     plane < reader.getImageCount();
+                     ++plane)
+                  {
+                    reader.setPlane(plane);
+
+                    switch(mode)
+                      {
+                      case RANDOM:
+                        {
+                          // As many windows as would tile the plane once.
+                          dimension_size_type count = ((sizex + w - 1) / w) * ((sizey + h - 1) / h);
+                          std::uniform_int_distribution<dimension_size_type> xdist(0, sizex - w);
+                          std::uniform_int_distribution<dimension_size_type> ydist(0, sizey - h);
+                          for (dimension_size_type r = 0; r < count; ++r)
+                            {
+                              dimension_size_type x = xdist(rng);
+                              dimension_size_type y = ydist(rng);
+                              read_region(reader, plane, buf, x, y, w, h, tilew, tileh, bytes);
+                            }
+                        }
+                        break;
+                      case SLIDING:
+                        {
+                          dimension_size_type step = roisize - overlap;
+                          for (dimension_size_type y = 0; y < sizey; y += step)
+                            {
+                              dimension_size_type sy = std::min(h, sizey - y);
+                              for (dimension_size_type x = 0; x < sizex; x += step)
+                                {
+                                  dimension_size_type sx = std::min(w, sizex - x);
+                                  read_region(reader, plane, buf, x, y, sx, sy, tilew, tileh, bytes);
+                                  if (x + sx >= sizex)
+                                    break;
+                                }
+                              if (y + sy >= sizey)
+                                break;
+                            }
+                        }
+                        break;
+                      case ROW:
+                        for (dimension_size_type y = 0; y < sizey; ++y)
+                          read_region(reader, plane, buf, 0, y, sizex, 1, tilew, tileh, bytes);
+                        break;
+                      }
+                    std::cout << '.' << std::flush;
+                  }
+                std::cout << " done\n" << std::flush;
+              }
+          }
+
+          timepoint read_end;
+          io_counters io_end;
+
+          result(results, testname, infile, read_start, read_end);
+          result(results, testname + ".init", infile, read_start, read_init);
+          result(results, testname + ".pixels", infile, read_init, read_end);
+
+          // The tile size recorded is that of the last series read.
+          extra_result(amplification, testname, infile,
+                       modename, roisize, mode == SLIDING ? overlap : 0,
+                       tilew, tileh, bytes.count,
+                       bytes.returned, bytes.decoded,
+                       io_end.rchar - io_start.rchar,
+                       io_end.read_bytes - io_start.read_bytes);
+        }
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
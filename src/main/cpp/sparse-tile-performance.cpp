@@ -0,0 +1,393 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "fill.h"
+#include "result.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <ome/compat/array.h>
+#include <ome/common/log.h>
+
+#include <ome/files/tiff/TIFF.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/PixelProperties.h>
+#include <ome/files/VariantPixelBuffer.h>
+
+#include <tiffio.h>
+
+using namespace ome::files::tiff;
+using ome::files::VariantPixelBuffer;
+using ome::files::dimension_size_type;
+using ome::xml::model::enums::PixelType;
+
+// libtiff's ::TIFF is also visible, so ome::files::tiff::TIFF is
+// fully qualified below.
+
+namespace
+{
+
+  enum writer_mode
+    {
+      FULL,  ///< Write every tile.
+      ELIDE  ///< Skip tiles containing only zero.
+    };
+
+  struct test_data
+  {
+    int iteration;
+    PixelType pixeltype;
+    unsigned int sizex;
+    unsigned int sizey;
+    unsigned int tilesize;
+    unsigned char background;
+    double fraction;
+    std::string description;
+    boost::filesystem::path output_file;
+  };
+
+  /**
+   * Get the raw storage of a pixel buffer.
+   */
+  struct RawBytesVisitor : public boost::static_visitor<>
+  {
+    char *data = nullptr;
+    std::size_t size = 0;
+
+    template<typename T>
+    void
+    operator() (std::shared_ptr<ome::files::PixelBuffer<T>>& buffer)
+    {
+      data = reinterpret_cast<char *>(buffer->data());
+      size = buffer->num_elements() * sizeof(T);
+    }
+  };
+
+  /**
+   * Check if every byte in a buffer has the same value.
+   *
+   * Comparing the buffer with itself offset by one byte lets memcmp
+   * use its vectorised implementation; it returns at the first
+   * difference, so tiles with content are rejected quickly.
+   *
+   * @param data the buffer to check.
+   * @param size the buffer size in bytes.
+   * @returns @c true if all bytes are equal to the first byte.
+   */
+  bool
+  is_constant(const char *data,
+              std::size_t size)
+  {
+    return size && std::memcmp(data, data + 1, size - 1) == 0;
+  }
+
+  /**
+   * Find the tiles which were not written.
+   *
+   * libtiff leaves the offset and byte count of unwritten tiles as
+   * zero.  The OME-Files TIFF wrapper does not expose the byte counts,
+   * so they are read directly with libtiff.
+   *
+   * @param path the TIFF file.
+   * @returns a flag for each tile in libtiff tile order, set if the
+   * tile is missing.
+   */
+  std::vector<bool>
+  missing_tiles(const boost::filesystem::path& path)
+  {
+    ::TIFF *tiff = TIFFOpen(path.string().c_str(), "r");
+    if (!tiff)
+      throw std::runtime_error(std::string("Failed to open ") + path.string());
+
+    std::vector<bool> missing(TIFFNumberOfTiles(tiff), false);
+    uint64_t *bytecounts = nullptr;
+    if (TIFFGetField(tiff, TIFFTAG_TILEBYTECOUNTS, &bytecounts) && bytecounts)
+      for (std::size_t i = 0; i < missing.size(); ++i)
+        missing[i] = (bytecounts[i] == 0);
+    TIFFClose(tiff);
+
+    return missing;
+  }
+
+  void
+  run_tests(const std::vector<test_data>& tests,
+            std::ofstream& results,
+            std::ofstream& sparse)
+  {
+    for (const auto& t : tests)
+      {
+        std::cout << "TEST: [" << t.iteration << "] " << t.description << std::endl;
+
+        unsigned int tilexcount = t.sizex / t.tilesize;
+        unsigned int tileycount = t.sizey / t.tilesize;
+        dimension_size_type tilecount = static_cast<dimension_size_type>(tilexcount) * tileycount;
+
+        // The same tiles are sparse for both writers and all
+        // iterations.
+        std::vector<bool> background_tile(tilecount);
+        std::mt19937 rng(6421);
+        std::bernoulli_distribution choose(t.fraction);
+        for (dimension_size_type i = 0; i < tilecount; ++i)
+          background_tile[i] = choose(rng);
+        dimension_size_type sparsecount = std::count(background_tile.begin(), background_tile.end(), true);
+
+        // Tiles with content are filled with random data, to avoid
+        // them being detected as constant.
+        RandomFillVisitor random_fill;
+        VariantPixelBuffer content(boost::extents[t.tilesize][t.tilesize][1][1][1][1][1][1][1],
+                                   t.pixeltype);
+        boost::apply_visitor(random_fill, content.vbuffer());
+
+        VariantPixelBuffer background(boost::extents[t.tilesize][t.tilesize][1][1][1][1][1][1][1],
+                                      t.pixeltype);
+        RawBytesVisitor background_bytes;
+        boost::apply_visitor(background_bytes, background.vbuffer());
+        std::memset(background_bytes.data, t.background, background_bytes.size);
+
+        for (writer_mode mode : {FULL, ELIDE})
+          {
+            std::string modename(mode == FULL ? "full" : "elide");
+
+            boost::filesystem::remove(t.output_file);
+
+            timepoint write_start;
+
+            auto tiff = ome::files::tiff::TIFF::open(t.output_file, "w8");
+            auto ifd = tiff->getCurrentDirectory();
+            ifd->setImageWidth(t.sizex);
+            ifd->setImageHeight(t.sizey);
+            ifd->setTileType(TILE);
+            ifd->setTileWidth(t.tilesize);
+            ifd->setTileHeight(t.tilesize);
+
+            ifd->setPixelType(t.pixeltype);
+            ifd->setBitsPerSample(ome::files::bitsPerPixel(t.pixeltype));
+            ifd->setSamplesPerPixel(1);
+            ifd->setPlanarConfiguration(CONTIG);
+            ifd->setPhotometricInterpretation(MIN_IS_BLACK);
+
+            dimension_size_type constant = 0;
+            dimension_size_type elided = 0;
+            for (unsigned int tiley = 0; tiley < tileycount; ++tiley)
+              for (unsigned int tilex = 0; tilex < tilexcount; ++tilex)
+                {
+                  VariantPixelBuffer& tile =
+                    background_tile[tiley * tilexcount + tilex] ? background : content;
+
+                  // Every tile is scanned, since the writer cannot
+                  // know in advance which tiles are constant.  Only
+                  // zero tiles are elided, since TIFF readers fill
+                  // missing tiles with zero; a tile with any other
+                  // constant value must be written to be preserved.
+                  if (mode == ELIDE)
+                    {
+                      RawBytesVisitor bytes;
+                      boost::apply_visitor(bytes, tile.vbuffer());
+                      if (is_constant(bytes.data, bytes.size))
+                        {
+                          ++constant;
+                          if (bytes.data[0] == 0)
+                            {
+                              ++elided;
+                              continue;
+                            }
+                        }
+                    }
+
+                  ifd->writeImage(tile, tilex * t.tilesize, tiley * t.tilesize,
+                                  t.tilesize, t.tilesize);
+                }
+            tiff->close();
+
+            timepoint write_end;
+
+            std::uintmax_t filesize = boost::filesystem::file_size(t.output_file);
+            result(results, "pixeldata.write.sparse." + modename, t.description,
+                   write_start, write_end);
+
+            // Read back, filling missing tiles with zero.
+            VariantPixelBuffer buf(boost::extents[t.tilesize][t.tilesize][1][1][1][1][1][1][1],
+                                   t.pixeltype);
+            RawBytesVisitor buf_bytes;
+            boost::apply_visitor(buf_bytes, buf.vbuffer());
+
+            timepoint read_start;
+
+            std::vector<bool> missing = missing_tiles(t.output_file);
+            auto rtiff = ome::files::tiff::TIFF::open(t.output_file, "r");
+            auto rifd = rtiff->getDirectoryByIndex(0);
+            dimension_size_type reconstructed = 0;
+            for (unsigned int tiley = 0; tiley < tileycount; ++tiley)
+              for (unsigned int tilex = 0; tilex < tilexcount; ++tilex)
+                {
+                  if (missing.at(tiley * tilexcount + tilex))
+                    {
+                      std::memset(buf_bytes.data, 0, buf_bytes.size);
+                      ++reconstructed;
+                    }
+                  else
+                    rifd->readImage(buf, tilex * t.tilesize, tiley * t.tilesize,
+                                    t.tilesize, t.tilesize);
+                }
+            rtiff->close();
+
+            timepoint read_end;
+
+            result(results, "pixeldata.read.sparse." + modename, t.description,
+                   read_start, read_end);
+            extra_result(sparse, "pixeldata.sparse." + modename, t.description,
+                         t.fraction, tilecount, sparsecount, constant, elided,
+                         filesize, reconstructed,
+                         elapsed_real(write_start, write_end),
+                         elapsed_real(read_start, read_end));
+          }
+      }
+
+    // Intermediate cleanup
+    for (const auto& t : tests)
+      boost::filesystem::remove(t.output_file);
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 13)
+    {
+      std::cerr << "Usage: " << argv[0] << " iterations sizex sizey tilesize pixeltype empty|constant fractionstart fractionend fractionstep outputfileprefix resultfile sparsefile\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      int iterations = std::strtol(argv[1], nullptr, 10);
+      unsigned int sizex = std::strtoul(argv[2], nullptr, 10);
+      unsigned int sizey = std::strtoul(argv[3], nullptr, 10);
+      unsigned int tilesize = std::strtoul(argv[4], nullptr, 10);
+      std::string pixeltype(argv[5]);
+      std::string content(argv[6]);
+      double fractionstart = std::strtod(argv[7], nullptr);
+      double fractionend = std::strtod(argv[8], nullptr);
+      double fractionstep = std::strtod(argv[9], nullptr);
+      std::string outfileprefix(argv[10]);
+      boost::filesystem::path resultfile(argv[11]);
+      boost::filesystem::path sparsefile(argv[12]);
+
+      // Empty tiles are zero-filled and may be elided; constant tiles
+      // have every byte set to a non-zero value, so are detected but
+      // always written.
+      unsigned char background = 0;
+      if (content == "constant")
+        background = 0x80;
+      else if (content != "empty")
+        {
+          std::cerr << "Invalid sparse content: " << content << '\n';
+          std::exit(1);
+        }
+
+      if (tilesize == 0 || sizex % tilesize || sizey % tilesize)
+        throw std::runtime_error("Image size must be a multiple of the tile size");
+      if (fractionstart < 0.0 || fractionend > 1.0 || fractionstep <= 0.0 ||
+          fractionend < fractionstart)
+        throw std::runtime_error("Invalid sparse fraction range");
+
+      std::vector<test_data> tests;
+      unsigned int steps = static_cast<unsigned int>(std::floor((fractionend - fractionstart) / fractionstep + 0.5));
+      for (unsigned int step = 0; step <= steps; ++step)
+        {
+          double fraction = std::min(fractionstart + step * fractionstep, 1.0);
+          test_data t {0, {pixeltype}, sizex, sizey, tilesize, background, fraction, {}, {}};
+
+          std::ostringstream desc;
+          desc << t.sizex << '-' << t.sizey << '-'
+               << t.tilesize << '-' << t.pixeltype << '-'
+               << content << '-' << t.fraction;
+          t.description = desc.str();
+
+          t.output_file = outfileprefix + '-' + desc.str() + ".tiff";
+
+          tests.push_back(t);
+        }
+
+      std::ofstream results(resultfile.string().c_str());
+      std::ofstream sparse(sparsefile.string().c_str());
+
+      result_header(results);
+      extra_result_header(sparse,
+                          {{"fraction"}, {"tiles"}, {"tiles.sparse"}, {"tiles.constant"}, {"tiles.elided"},
+                           {"filesize"}, {"tiles.reconstructed"}, {"write"}, {"read"}});
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          // Randomise test order.
+          std::random_device rd;
+          std::mt19937 g(rd());
+          std::shuffle(tests.begin(), tests.end(), g);
+          for (auto& t : tests)
+            t.iteration = i;
+
+          run_tests(tests, results, sparse);
+        }
+
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
@@ -0,0 +1,382 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "result.h"
+#include "tile-cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/filesystem.hpp>
+
+#include <ome/common/log.h>
+
+#include <ome/files/VariantPixelBuffer.h>
+#include <ome/files/tiff/IFD.h>
+#include <ome/files/tiff/TIFF.h>
+
+using ome::files::dimension_size_type;
+
+namespace
+{
+
+  /**
+   * A single viewer request for a region of an image.
+   */
+  struct viewport
+  {
+    std::uint32_t ifd;
+    dimension_size_type x;
+    dimension_size_type y;
+    dimension_size_type w;
+    dimension_size_type h;
+  };
+
+  /// The requests made by each client.
+  typedef std::vector<std::vector<viewport>> trace_type;
+
+  /**
+   * Create a synthetic pan trace.
+   *
+   * Each client starts at the centre of the image with a 1024x1024
+   * viewport at full resolution, and at each step pans by up to half
+   * the viewport size.  All clients start from the same place, so
+   * their hot tiles overlap.  Zooming is not modelled, since a viewer
+   * would switch to a lower resolution rather than reading more
+   * full-resolution tiles; a recorded trace may be used to model
+   * zooming over a pyramid.
+   *
+   * @param clients the number of clients.
+   * @param requests the number of requests per client.
+   * @param sizex the image width.
+   * @param sizey the image height.
+   * @returns the trace.
+   */
+  trace_type
+  synthetic_trace(unsigned int clients,
+                  dimension_size_type requests,
+                  dimension_size_type sizex,
+                  dimension_size_type sizey)
+  {
+    const dimension_size_type screen = 1024;
+
+    trace_type trace(clients);
+    for (unsigned int client = 0; client < clients; ++client)
+      {
+        std::mt19937 rng(9343 + client);
+        std::uniform_real_distribution<double> pan(-0.5, 0.5);
+
+        dimension_size_type w = std::min(screen, sizex);
+        dimension_size_type h = std::min(screen, sizey);
+        double cx = sizex / 2.0;
+        double cy = sizey / 2.0;
+
+        for (dimension_size_type r = 0; r < requests; ++r)
+          {
+            cx += pan(rng) * w;
+            cy += pan(rng) * h;
+            cx = std::min(std::max(cx, w / 2.0), sizex - w / 2.0);
+            cy = std::min(std::max(cy, h / 2.0), sizey - h / 2.0);
+
+            trace.at(client).push_back(viewport{0,
+                  static_cast<dimension_size_type>(cx - w / 2.0),
+                  static_cast<dimension_size_type>(cy - h / 2.0),
+                  w, h});
+          }
+      }
+    return trace;
+  }
+
+  /**
+   * Read a recorded trace.
+   *
+   * Each line contains "client ifd x y w h".  Blank lines and lines
+   * starting with '#' are ignored.  Requests are assigned to the
+   * client threads by client number modulo the number of threads.
+   *
+   * @param tracefile the trace to read.
+   * @param clients the number of clients.
+   * @returns the trace.
+   */
+  trace_type
+  read_trace(const boost::filesystem::path& tracefile,
+             unsigned int clients)
+  {
+    std::ifstream in(tracefile.string().c_str());
+    if (!in)
+      throw std::runtime_error("Failed to open trace " + tracefile.string());
+
+    trace_type trace(clients);
+    std::string line;
+    while (std::getline(in, line))
+      {
+        if (line.empty() || line[0] == '#')
+          continue;
+        std::istringstream is(line);
+        unsigned int client;
+        viewport v;
+        if (!(is >> client >> v.ifd >> v.x >> v.y >> v.w >> v.h))
+          throw std::runtime_error("Invalid trace line: " + line);
+        trace.at(client % clients).push_back(v);
+      }
+    return trace;
+  }
+
+  /**
+   * Results for a single client.
+   */
+  struct client_result
+  {
+    /// Latency of each request in microseconds.
+    std::vector<double> latency;
+    /// Number of tiles requested.
+    std::uint64_t tiles;
+  };
+
+  /**
+   * Replay a client's requests.
+   *
+   * Each client opens its own TIFF, since TIFF handles are not
+   * thread-safe.
+   *
+   * @param infile the TIFF to read.
+   * @param requests the requests to replay.
+   * @param cache the tile cache to use, or null to read every tile.
+   * @param result the client results.
+   */
+  void
+  replay(const boost::filesystem::path& infile,
+         const std::vector<viewport>& requests,
+         tile_cache *cache,
+         client_result& result)
+  {
+    auto tiff = ome::files::tiff::TIFF::open(infile, "r");
+    std::map<std::uint32_t, std::shared_ptr<ome::files::tiff::IFD>> ifds;
+
+    result.latency.reserve(requests.size());
+    result.tiles = 0;
+
+    for (const auto& v : requests)
+      {
+        auto start = boost::chrono::steady_clock::now();
+
+        std::shared_ptr<ome::files::tiff::IFD>& ifd = ifds[v.ifd];
+        if (!ifd)
+          ifd = tiff->getDirectoryByIndex(v.ifd);
+
+        dimension_size_type sizex = ifd->getImageWidth();
+        dimension_size_type sizey = ifd->getImageHeight();
+        dimension_size_type tilew = ifd->getTileWidth();
+        dimension_size_type tileh = ifd->getTileHeight();
+        dimension_size_type across = (sizex + tilew - 1) / tilew;
+
+        dimension_size_type endx = std::min(v.x + v.w, sizex);
+        dimension_size_type endy = std::min(v.y + v.h, sizey);
+
+        for (dimension_size_type ty = v.y / tileh; ty * tileh < endy; ++ty)
+          for (dimension_size_type tx = v.x / tilew; tx * tilew < endx; ++tx)
+            {
+              dimension_size_type x = tx * tilew;
+              dimension_size_type y = ty * tileh;
+              dimension_size_type w = std::min(tilew, sizex - x);
+              dimension_size_type h = std::min(tileh, sizey - y);
+
+              tile_cache::loader_type load = [&ifd, x, y, w, h]()
+                {
+                  auto buf = std::make_shared<ome::files::VariantPixelBuffer>();
+                  ifd->readImage(*buf, x, y, w, h);
+                  return tile_cache::value_type(buf);
+                };
+
+              if (cache)
+                cache->get(tile_key{0, v.ifd, ty * across + tx}, load);
+              else
+                load();
+              ++result.tiles;
+            }
+
+        auto end = boost::chrono::steady_clock::now();
+        result.latency.push_back(boost::chrono::duration_cast<boost::chrono::microseconds>(end - start).count());
+      }
+  }
+
+  double
+  percentile(const std::vector<double>& sorted,
+             double p)
+  {
+    if (sorted.empty())
+      return 0.0;
+    std::size_t i = static_cast<std::size_t>(p * sorted.size());
+    return sorted.at(std::min(i, sorted.size() - 1));
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 9 && argc != 10)
+    {
+      std::cerr << "Usage: " << argv[0] << " iterations inputfile threads cachesize synthetic|tracefile requests resultfile statsfile [none|compact|scatter|node|interleave]\n"
+                << "\n"
+                << "cachesize is in MiB.  requests is the number of requests per client\n"
+                << "for a synthetic trace, and is ignored for a recorded trace.\n";
+      std::exit(1);
+    }
+
+  try
+    {
+      ome::common::setLogLevel(ome::logging::trivial::warning);
+
+      int iterations = std::atoi(argv[1]);
+      boost::filesystem::path infile(argv[2]);
+      unsigned int threads = std::strtoul(argv[3], nullptr, 10);
+      std::size_t cachesize = std::strtoull(argv[4], nullptr, 10) * 1024 * 1024;
+      std::string tracename(argv[5]);
+      dimension_size_type requests = std::strtoull(argv[6], nullptr, 10);
+      boost::filesystem::path resultfile(argv[7]);
+      boost::filesystem::path statsfile(argv[8]);
+      placement_policy policy = parse_placement(argc == 10 ? argv[9] : "none");
+
+      if (threads == 0)
+        {
+          std::cerr << "Invalid thread count: " << threads << '\n';
+          std::exit(1);
+        }
+
+      trace_type trace;
+      if (tracename == "synthetic")
+        {
+          auto tiff = ome::files::tiff::TIFF::open(infile, "r");
+          auto ifd = tiff->getDirectoryByIndex(0);
+          trace = synthetic_trace(threads, requests, ifd->getImageWidth(), ifd->getImageHeight());
+        }
+      else
+        trace = read_trace(tracename, threads);
+
+      std::ofstream results(resultfile.string().c_str());
+      std::ofstream stats(statsfile.string().c_str());
+
+      result_header(results);
+      extra_result_header(stats,
+                          {{"cache.size"}, {"placement"}, {"threads"}, {"cpus"}, {"iteration"},
+                           {"requests"}, {"tiles"},
+                           {"hits"}, {"misses"}, {"evictions"}, {"hit.rate"},
+                           {"latency.mean"}, {"latency.p50"}, {"latency.p99"},
+                           {"throughput"}});
+
+      for(int i = 0; i < iterations; ++i)
+        {
+          for (bool cached : {false, true})
+            {
+              std::string testname(cached ? "tile.read.cache" : "tile.read.nocache");
+              std::cout << "TEST: [" << i << "] " << testname << " with " << threads << " clients..." << std::flush;
+
+              std::unique_ptr<tile_cache> cache;
+              if (cached)
+                cache = std::make_unique<tile_cache>(cachesize);
+
+              std::vector<client_result> clients(threads);
+
+              timepoint read_start;
+
+              std::string cpus = run_threads(threads, policy,
+                                             [&](unsigned int t)
+                                             {
+                                               replay(infile, trace.at(t), cache.get(), clients.at(t));
+                                             });
+
+              timepoint read_end;
+
+              std::cout << "done\n" << std::flush;
+
+              std::vector<double> latency;
+              std::uint64_t tiles = 0;
+              for (const auto& client : clients)
+                {
+                  latency.insert(latency.end(), client.latency.begin(), client.latency.end());
+                  tiles += client.tiles;
+                }
+              std::sort(latency.begin(), latency.end());
+
+              double mean = 0.0;
+              for (auto l : latency)
+                mean += l;
+              if (!latency.empty())
+                mean /= latency.size();
+
+              double real = boost::chrono::duration_cast<cpu_clock_milliseconds>(read_end.process - read_start.process).count().real;
+              double throughput = real > 0.0 ? latency.size() / (real / 1000.0) : 0.0;
+
+              tile_cache::statistics s {0, 0, 0, 0};
+              if (cache)
+                s = cache->stats();
+              double hitrate = (s.hits + s.misses) ? static_cast<double>(s.hits) / (s.hits + s.misses) : 0.0;
+
+              result(results, testname, infile, read_start, read_end);
+              extra_result(stats, testname, infile,
+                           cached ? cachesize : 0, placement_name(policy), threads, cpus, i,
+                           latency.size(), tiles,
+                           s.hits, s.misses, s.evictions, hitrate,
+                           mean / 1000.0,
+                           percentile(latency, 0.50) / 1000.0,
+                           percentile(latency, 0.99) / 1000.0,
+                           throughput);
+            }
+        }
+      return 0;
+    }
+  catch(const std::exception &e)
+    {
+      std::cerr << "Error: caught exception: " << e.what() << '\n';
+    }
+  catch(...)
+    {
+      std::cerr << "Error: unknown exception\n";
+    }
+  exit(1);
+}
@@ -0,0 +1,123 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "tile-cache.h"
+
+#include <ome/files/PixelProperties.h>
+
+tile_cache::tile_cache(std::size_t capacity,
+                       unsigned int shards):
+  shard_capacity(capacity / (shards ? shards : 1)),
+  shards()
+{
+  for (unsigned int s = 0; s < (shards ? shards : 1); ++s)
+    this->shards.push_back(std::make_unique<shard>());
+}
+
+tile_cache::value_type
+tile_cache::get(const tile_key& key,
+                const loader_type& load)
+{
+  shard& s(select(key));
+
+  {
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto found = s.index.find(key);
+    if (found != s.index.end())
+      {
+        s.lru.splice(s.lru.begin(), s.lru, found->second);
+        ++s.stats.hits;
+        return found->second->value;
+      }
+    ++s.stats.misses;
+  }
+
+  value_type value(load());
+  std::size_t bytes = value->num_elements() * ome::files::bytesPerPixel(value->pixelType());
+
+  // Tiles larger than a shard are never cached.
+  if (bytes > shard_capacity)
+    return value;
+
+  std::lock_guard<std::mutex> guard(s.lock);
+
+  auto found = s.index.find(key);
+  if (found != s.index.end())
+    {
+      // Loaded concurrently by another thread; replace it.
+      s.stats.bytes -= found->second->bytes;
+      s.lru.erase(found->second);
+      s.index.erase(found);
+    }
+
+  while (!s.lru.empty() && s.stats.bytes + bytes > shard_capacity)
+    {
+      const entry& victim(s.lru.back());
+      s.stats.bytes -= victim.bytes;
+      s.index.erase(victim.key);
+      s.lru.pop_back();
+      ++s.stats.evictions;
+    }
+
+  s.lru.push_front(entry{key, value, bytes});
+  s.index.insert(std::make_pair(key, s.lru.begin()));
+  s.stats.bytes += bytes;
+
+  return value;
+}
+
+tile_cache::statistics
+tile_cache::stats() const
+{
+  statistics total {0, 0, 0, 0};
+  for (const auto& s : shards)
+    {
+      std::lock_guard<std::mutex> guard(s->lock);
+      total.hits += s->stats.hits;
+      total.misses += s->stats.misses;
+      total.evictions += s->stats.evictions;
+      total.bytes += s->stats.bytes;
+    }
+  return total;
+}
+
+tile_cache::shard&
+tile_cache::select(const tile_key& key)
+{
+  return *shards[tile_key_hash()(key) % shards.size()];
+}
@@ -0,0 +1,182 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <ome/files/VariantPixelBuffer.h>
+
+/**
+ * Key identifying a single decoded tile.
+ */
+struct tile_key
+{
+  /// Index of the file containing the tile.
+  std::uint32_t file;
+  /// Index of the IFD within the file.
+  std::uint32_t ifd;
+  /// Index of the tile within the IFD.
+  std::uint64_t tile;
+
+  bool
+  operator== (const tile_key& rhs) const
+  {
+    return file == rhs.file && ifd == rhs.ifd && tile == rhs.tile;
+  }
+};
+
+/**
+ * Hash function for tile_key.
+ */
+struct tile_key_hash
+{
+  std::size_t
+  operator() (const tile_key& key) const
+  {
+    std::uint64_t h = (static_cast<std::uint64_t>(key.file) << 32) ^ key.ifd;
+    h ^= key.tile + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return std::hash<std::uint64_t>()(h);
+  }
+};
+
+/**
+ * Size-bounded least recently used cache of decoded tiles.
+ *
+ * The cache is split into independently locked shards, selected by
+ * the key hash, so that concurrent lookups of different tiles rarely
+ * contend.  Each shard holds an equal share of the total capacity,
+ * and evicts its least recently used tiles when full.  Tiles are
+ * shared and immutable, so a tile remains valid for a caller after
+ * it is evicted.
+ */
+class tile_cache
+{
+public:
+  /// A cached tile.
+  typedef std::shared_ptr<const ome::files::VariantPixelBuffer> value_type;
+
+  /// Function to load a tile on a cache miss.
+  typedef std::function<value_type()> loader_type;
+
+  /// Cache statistics.
+  struct statistics
+  {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+    /// Current size of all cached tiles.
+    std::size_t bytes;
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param capacity the maximum size of all cached tiles in bytes.
+   * @param shards the number of shards.
+   */
+  explicit
+  tile_cache(std::size_t capacity,
+             unsigned int shards = 16);
+
+  /**
+   * Get a tile, loading it on a cache miss.
+   *
+   * The loader is called without holding any lock, so concurrent
+   * misses for the same tile may load it more than once; the last
+   * tile loaded is retained.
+   *
+   * @param key the tile to get.
+   * @param load the function to load the tile.
+   * @returns the tile.
+   */
+  value_type
+  get(const tile_key& key,
+      const loader_type& load);
+
+  /**
+   * Get the cache statistics.
+   *
+   * @returns the statistics summed over all shards.
+   */
+  statistics
+  stats() const;
+
+private:
+  struct entry
+  {
+    tile_key key;
+    value_type value;
+    std::size_t bytes;
+  };
+
+  struct shard
+  {
+    shard():
+      lock(),
+      lru(),
+      index(),
+      stats{0, 0, 0, 0}
+    {}
+
+    mutable std::mutex lock;
+    /// Most recently used first.
+    std::list<entry> lru;
+    std::unordered_map<tile_key, std::list<entry>::iterator, tile_key_hash> index;
+    statistics stats;
+  };
+
+  shard&
+  select(const tile_key& key);
+
+  std::size_t shard_capacity;
+  std::vector<std::unique_ptr<shard>> shards;
+};
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */
@@ -0,0 +1,127 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#include "write-behind.h"
+
+#include <utility>
+
+write_behind::write_behind(std::size_t depth):
+  depth(depth ? depth : 1),
+  outstanding(0),
+  stop(false),
+  queue(),
+  error(),
+  lock(),
+  changed(),
+  worker(&write_behind::run, this)
+{
+}
+
+write_behind::~write_behind()
+{
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    stop = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+void
+write_behind::submit(std::function<void()> task)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this]{ return outstanding < depth || error; });
+  check_error();
+  queue.push_back(std::move(task));
+  ++outstanding;
+  changed.notify_all();
+}
+
+void
+write_behind::wait()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this]{ return outstanding == 0; });
+  check_error();
+}
+
+void
+write_behind::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true)
+    {
+      changed.wait(guard, [this]{ return !queue.empty() || stop; });
+      if (queue.empty())
+        break;
+
+      std::function<void()> task(std::move(queue.front()));
+      queue.pop_front();
+
+      // Once a task has failed, drain the remaining tasks without
+      // running them, so that the producer is not left waiting.
+      if (!error)
+        {
+          guard.unlock();
+          try
+            {
+              task();
+            }
+          catch (...)
+            {
+              guard.lock();
+              error = std::current_exception();
+              guard.unlock();
+            }
+          guard.lock();
+        }
+
+      --outstanding;
+      changed.notify_all();
+    }
+}
+
+void
+write_behind::check_error()
+{
+  // The error is kept, so that no further tasks are run after a
+  // failure, including while the producer is unwinding.
+  if (error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,117 @@
+/*
+ * #%L
+ * OME Files performance tests
+ * %%
+ * Copyright © 2017 Open Microscopy Environment:
+ *   - Massachusetts Institute of Technology
+ *   - National Institutes of Health
+ *   - University of Dundee
+ *   - Board of Regents of the University of Wisconsin-Madison
+ *   - Glencoe Software, Inc.
+ * %%
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of any organization.
+ * #L%
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * Asynchronous write-behind queue.
+ *
+ * Write tasks are run in submission order by a single background I/O
+ * thread, allowing the producer to compute the next tile or plane
+ * while the previous one is being written.  The number of outstanding
+ * (queued or running) tasks is bounded by the queue depth; submitting
+ * a task blocks while the queue is full.  With a depth of @c n, a
+ * producer may safely cycle through @c n+1 buffers; a depth of one
+ * gives classic double buffering.
+ *
+ * All use of the writer must be submitted via the queue, since the
+ * underlying writers are not thread-safe.  If a task throws, no
+ * further tasks are run, and the exception is rethrown by every
+ * subsequent call to submit() or wait().
+ */
+class write_behind
+{
+public:
+  /**
+   * Constructor.
+   *
+   * @param depth the maximum number of outstanding tasks.
+   */
+  explicit
+  write_behind(std::size_t depth = 1);
+
+  /// Destructor.  Outstanding tasks are completed before returning,
+  /// unless a task has failed, in which case they are discarded.
+  ~write_behind();
+
+  /**
+   * Submit a write task.
+   *
+   * @param task the task to run on the I/O thread.
+   */
+  void
+  submit(std::function<void()> task);
+
+  /**
+   * Wait for all outstanding tasks to complete.
+   */
+  void
+  wait();
+
+private:
+  /// I/O thread main loop.
+  void
+  run();
+
+  /// Rethrow any exception thrown by a task.  Requires the lock be held.
+  void
+  check_error();
+
+  std::size_t depth;
+  std::size_t outstanding;
+  bool stop;
+  std::deque<std::function<void()>> queue;
+  std::exception_ptr error;
+  std::mutex lock;
+  std::condition_variable changed;
+  std::thread worker;
+};
+
+/*
+ * Local Variables:
+ * mode:C++
+ * End:
+ */